@@ -0,0 +1,128 @@
+#include "plic.h"
+#include "kernel.h"
+#include "sync.h"
+#include "printf.h"
+#include "trap.h"
+#include "types.h"
+
+/* Register layout of the SiFive PLIC used by QEMU virt */
+#define PLIC_PRIORITY(irq)     (PLIC_BASE + (irq) * 4)
+#define PLIC_ENABLE(ctx)       (PLIC_BASE + 0x2000 + (ctx) * 0x80)
+#define PLIC_THRESHOLD(ctx)    (PLIC_BASE + 0x200000 + (ctx) * 0x1000)
+#define PLIC_CLAIM(ctx)        (PLIC_BASE + 0x200004 + (ctx) * 0x1000)
+
+/* Contexts alternate M/S per hart: hart h's S-mode context is 2h + 1 */
+#define PLIC_S_CONTEXT(hart)   ((hart) * 2 + 1)
+
+typedef struct {
+    irq_handler_t fn;
+    void* arg;
+    int hart;               /* Target hart, -1 while unrouted */
+    uint64_t count;
+} plic_source_t;
+
+static plic_source_t sources[PLIC_NUM_IRQS];
+static int hart_online[PLIC_MAX_HARTS];
+static int hart_sources[PLIC_MAX_HARTS];
+static spinlock_t plic_lock;
+
+static inline volatile uint32_t* plic_reg(uint64_t addr) {
+    return (volatile uint32_t*)addr;
+}
+
+static void plic_route(uint32_t irq, int hart, int enable) {
+    volatile uint32_t* reg = plic_reg(PLIC_ENABLE(PLIC_S_CONTEXT(hart)) + (irq / 32) * 4);
+    if (enable) {
+        *reg |= 1U << (irq % 32);
+    } else {
+        *reg &= ~(1U << (irq % 32));
+    }
+}
+
+void plic_init(void) {
+    spinlock_init(&plic_lock);
+    for (uint32_t irq = 1; irq < PLIC_NUM_IRQS; irq++) {
+        sources[irq].hart = -1;
+        plic_set_priority(irq, 0);
+    }
+}
+
+void plic_hart_init(uint32_t hartid) {
+    if (hartid >= PLIC_MAX_HARTS) {
+        return;
+    }
+
+    /* Accept every source with a nonzero priority */
+    plic_set_threshold(hartid, 0);
+    hart_online[hartid] = 1;
+
+    /* Let external interrupts reach S-mode */
+    asm volatile("csrs sie, %0" :: "r"(SIE_SEIE));
+}
+
+int plic_register(uint32_t irq, uint32_t priority, irq_handler_t fn, void* arg) {
+    if (irq == 0 || irq >= PLIC_NUM_IRQS || !fn || priority == 0) {
+        return -1;
+    }
+
+    spinlock_lock(&plic_lock);
+
+    /* Least-loaded online hart */
+    int hart = -1;
+    for (int h = 0; h < PLIC_MAX_HARTS; h++) {
+        if (hart_online[h] && (hart < 0 || hart_sources[h] < hart_sources[hart])) {
+            hart = h;
+        }
+    }
+    if (hart < 0) {
+        spinlock_unlock(&plic_lock);
+        return -1;
+    }
+
+    plic_source_t* src = &sources[irq];
+    if (src->hart >= 0) {
+        plic_route(irq, src->hart, 0);
+        hart_sources[src->hart]--;
+    }
+    src->fn = fn;
+    src->arg = arg;
+    src->hart = hart;
+    hart_sources[hart]++;
+
+    plic_set_priority(irq, priority);
+    plic_route(irq, hart, 1);
+
+    spinlock_unlock(&plic_lock);
+    return hart;
+}
+
+void plic_set_priority(uint32_t irq, uint32_t priority) {
+    *plic_reg(PLIC_PRIORITY(irq)) = priority;
+}
+
+void plic_set_threshold(uint32_t hartid, uint32_t threshold) {
+    *plic_reg(PLIC_THRESHOLD(PLIC_S_CONTEXT(hartid))) = threshold;
+}
+
+void plic_dispatch(void) {
+    volatile uint32_t* claim = plic_reg(PLIC_CLAIM(PLIC_S_CONTEXT(current_hart())));
+    uint32_t irq;
+
+    while ((irq = *claim) != 0) {
+        if (irq < PLIC_NUM_IRQS && sources[irq].fn) {
+            sources[irq].count++;
+            sources[irq].fn(irq, sources[irq].arg);
+        }
+        /* Complete even unhandled sources so they can fire again */
+        *claim = irq;
+    }
+}
+
+void plic_dump(void) {
+    printf("IRQ  HART  COUNT\r\n");
+    for (uint32_t irq = 1; irq < PLIC_NUM_IRQS; irq++) {
+        if (sources[irq].fn) {
+            printf("%d    %d     %lu\r\n", irq, sources[irq].hart, sources[irq].count);
+        }
+    }
+}
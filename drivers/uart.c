@@ -1,4 +1,6 @@
 #include "uart.h"
+#include "plic.h"
+#include "sync.h"
 #include "types.h"
 
 #define UART_RBR 0x00  /* Receive Buffer Register */
@@ -15,8 +17,41 @@
 #define UART_LSR_THRE 0x20  /* Transmit Holding Register Empty */
 #define UART_LSR_DR   0x01  /* Data Ready */
 
+#define UART_IER_RDI  0x01  /* Received data available */
+#define UART_IER_THRI 0x02  /* Transmit holding register empty */
+
+#define UART_FCR_ENABLE    0x01
+#define UART_FCR_CLEAR_RX  0x02
+#define UART_FCR_CLEAR_TX  0x04
+#define UART_FCR_TRIGGER_1 0x00  /* RX interrupt after every byte */
+
+#define UART_FIFO_SIZE 16
+
+/* Ring sizes must be powers of two; indices run freely */
+#define UART_TX_RING 1024
+#define UART_RX_RING 256
+
 static volatile uint8_t* uart_base = (volatile uint8_t*)UART_BASE;
 
+static struct {
+    char buf[UART_TX_RING];
+    uint32_t head;      /* Next byte to send */
+    uint32_t tail;      /* Next free slot */
+} tx;
+
+static struct {
+    char buf[UART_RX_RING];
+    uint32_t head;
+    uint32_t tail;
+} rx;
+
+static uint8_t uart_ier = 0;   /* Last value written to IER */
+static spinlock_t uart_lock;
+static wait_queue_t rx_wait;
+
+/* Until uart_init runs (early boot) the driver polls like before */
+static int uart_irq_on = 0;
+
 static inline uint8_t uart_read_reg(int reg) {
     return uart_base[reg];
 }
@@ -25,32 +60,154 @@ static inline void uart_write_reg(int reg, uint8_t val) {
     uart_base[reg] = val;
 }
 
+static void uart_set_ier(uint8_t ier) {
+    if (ier != uart_ier) {
+        uart_ier = ier;
+        uart_write_reg(UART_IER, ier);
+    }
+}
+
+/*
+ * Move queued bytes into the transmit FIFO. When THRE is set the FIFO
+ * is empty, so a whole FIFO's worth can go at once. The THRE interrupt
+ * stays enabled only while bytes are waiting. Caller holds uart_lock.
+ */
+static void uart_tx_fill(void) {
+    if (uart_read_reg(UART_LSR) & UART_LSR_THRE) {
+        for (int i = 0; i < UART_FIFO_SIZE && tx.head != tx.tail; i++) {
+            uart_write_reg(UART_THR, tx.buf[tx.head++ % UART_TX_RING]);
+        }
+    }
+    uart_set_ier(tx.head != tx.tail ? UART_IER_RDI | UART_IER_THRI : UART_IER_RDI);
+}
+
 void uart_init(void) {
-    /* UART is already initialized by QEMU, but we can set it up */
-    /* For now, just ensure it's ready */
+    spinlock_init(&uart_lock);
+    wait_queue_init(&rx_wait);
+
+    uart_write_reg(UART_IER, 0);
+    uart_write_reg(UART_FCR, UART_FCR_ENABLE | UART_FCR_CLEAR_RX |
+                             UART_FCR_CLEAR_TX | UART_FCR_TRIGGER_1);
+
+    if (plic_register(UART_IRQ, 1, uart_intr, NULL) < 0) {
+        return;  /* Nowhere to route it: keep polling */
+    }
+    uart_irq_on = 1;
+    uart_set_ier(UART_IER_RDI);
+}
+
+/* Queue one byte; only waits when the ring is full */
+static void uart_tx_put(char c) {
+    while (tx.tail - tx.head == UART_TX_RING) {
+        /* Ring full: drain into the FIFO by hand */
+        while (!(uart_read_reg(UART_LSR) & UART_LSR_THRE));
+        uart_tx_fill();
+    }
+    tx.buf[tx.tail++ % UART_TX_RING] = c;
 }
 
 void uart_putchar(char c) {
-    /* Wait for transmit buffer to be empty */
-    while (!(uart_read_reg(UART_LSR) & UART_LSR_THRE));
-    uart_write_reg(UART_THR, c);
-    
-    /* Add carriage return for newline */
-    if (c == '\n') {
+    if (!uart_irq_on) {
+        /* Wait for transmit buffer to be empty */
         while (!(uart_read_reg(UART_LSR) & UART_LSR_THRE));
-        uart_write_reg(UART_THR, '\r');
+        uart_write_reg(UART_THR, c);
+
+        /* Add carriage return for newline */
+        if (c == '\n') {
+            while (!(uart_read_reg(UART_LSR) & UART_LSR_THRE));
+            uart_write_reg(UART_THR, '\r');
+        }
+        return;
     }
+
+    uart_write(&c, 1);
+}
+
+/* Queue a whole buffer under one lock and fill the FIFO once */
+void uart_write(const char* s, size_t len) {
+    if (!uart_irq_on) {
+        for (size_t i = 0; i < len; i++) {
+            uart_putchar(s[i]);
+        }
+        return;
+    }
+
+    spinlock_lock(&uart_lock);
+    for (size_t i = 0; i < len; i++) {
+        uart_tx_put(s[i]);
+        /* Add carriage return for newline */
+        if (s[i] == '\n') {
+            uart_tx_put('\r');
+        }
+    }
+    uart_tx_fill();
+    spinlock_unlock(&uart_lock);
 }
 
 char uart_getchar(void) {
-    /* Wait for data to be available */
-    while (!(uart_read_reg(UART_LSR) & UART_LSR_DR));
-    return uart_read_reg(UART_RBR);
+    if (!uart_irq_on) {
+        /* Wait for data to be available */
+        while (!(uart_read_reg(UART_LSR) & UART_LSR_DR));
+        return uart_read_reg(UART_RBR);
+    }
+
+    /* Sleep until the interrupt handler queues a byte */
+    while (rx.head == rx.tail) {
+        wait_queue_sleep(&rx_wait);
+    }
+    return rx.buf[rx.head++ % UART_RX_RING];
+}
+
+int uart_trygetchar(void) {
+    if (!uart_irq_on) {
+        if (!(uart_read_reg(UART_LSR) & UART_LSR_DR)) {
+            return -1;
+        }
+        return uart_read_reg(UART_RBR);
+    }
+
+    if (rx.head == rx.tail) {
+        return -1;
+    }
+    return (unsigned char)rx.buf[rx.head++ % UART_RX_RING];
 }
 
 void uart_puts(const char* s) {
-    while (*s) {
-        uart_putchar(*s++);
+    size_t len = 0;
+    while (s[len]) {
+        len++;
+    }
+    uart_write(s, len);
+}
+
+/* Push out everything queued, for paths that never re-enable interrupts */
+void uart_flush(void) {
+    spinlock_lock(&uart_lock);
+    while (tx.head != tx.tail) {
+        while (!(uart_read_reg(UART_LSR) & UART_LSR_THRE));
+        uart_tx_fill();
     }
+    spinlock_unlock(&uart_lock);
 }
 
+/* UART interrupt: drain the RX FIFO, refill the TX FIFO */
+void uart_intr(uint32_t irq, void* arg) {
+    (void)irq;
+    (void)arg;
+    int received = 0;
+
+    spinlock_lock(&uart_lock);
+    while (uart_read_reg(UART_LSR) & UART_LSR_DR) {
+        char c = uart_read_reg(UART_RBR);
+        if (rx.tail - rx.head < UART_RX_RING) {
+            rx.buf[rx.tail++ % UART_RX_RING] = c;
+            received = 1;
+        }
+    }
+    uart_tx_fill();
+    spinlock_unlock(&uart_lock);
+
+    if (received) {
+        wait_queue_wake_all(&rx_wait);
+    }
+}
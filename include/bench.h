@@ -0,0 +1,22 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "types.h"
+
+/* Read the cycle counter */
+static inline uint64_t bench_cycles(void) {
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+/* Context-switch benchmark: address space switches with and without ASIDs */
+void bench_tlb_switch(void);
+
+/* Process creation benchmark: spawn vs fork+exec of the same program */
+void bench_spawn(const char* path);
+
+/* Syscall entry benchmark: getpid round trips from a user task */
+void bench_null_syscall(void);
+
+#endif
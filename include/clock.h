@@ -0,0 +1,58 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+#include "kernel.h"
+#include "paging.h"
+
+/*
+ * Clock data page. The kernel maps one read-only page at CLOCK_PAGE_BASE
+ * into every task; with the time CSR readable from user mode (see
+ * scounteren in trap_init) a program can timestamp with the helpers
+ * below instead of trapping. The wall offset changes at run time and is
+ * guarded by seq, which is odd while the kernel is rewriting it.
+ */
+#define CLOCK_PAGE_BASE (USER_STACK_TOP - USER_STACK_SIZE - 4 * PAGE_SIZE)
+
+#define NSEC_PER_SEC 1000000000UL
+
+typedef struct {
+    uint32_t seq;
+    uint32_t pad;
+    uint64_t freq;              /* time CSR ticks per second */
+    uint64_t boot_ticks;        /* time CSR at boot */
+    uint64_t wall_offset_ns;    /* Wall clock (ns since epoch) at ticks == 0 */
+} clock_page_t;
+
+static inline uint64_t clock_read_ticks(void) {
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+static inline uint64_t clock_ticks_to_ns(uint64_t ticks, uint64_t freq) {
+    return (ticks / freq) * NSEC_PER_SEC + (ticks % freq) * NSEC_PER_SEC / freq;
+}
+
+/* Nanoseconds since boot; freq and boot_ticks never change */
+static inline uint64_t clock_uptime_ns(const volatile clock_page_t* cp) {
+    return clock_ticks_to_ns(clock_read_ticks() - cp->boot_ticks, cp->freq);
+}
+
+/* Nanoseconds since the epoch, retried if the kernel updated the offset */
+static inline uint64_t clock_wall_ns(const volatile clock_page_t* cp) {
+    uint32_t seq;
+    uint64_t offset, ticks;
+
+    do {
+        seq = cp->seq;
+        asm volatile("fence r, r" ::: "memory");
+        offset = cp->wall_offset_ns;
+        ticks = clock_read_ticks();
+        asm volatile("fence r, r" ::: "memory");
+    } while ((seq & 1) || seq != cp->seq);
+
+    return offset + clock_ticks_to_ns(ticks, cp->freq);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define ELF_H
 
 #include "types.h"
+#include "vm.h"
 
 #define EI_NIDENT 16
 
@@ -38,7 +39,11 @@ typedef struct {
 #define PF_W 2
 #define PF_R 4
 
+/* Program headers are read in one batch into a fixed on-stack table */
+#define ELF_MAX_PHDRS 16
+
 int elf_load(const char* path, uint64_t* entry);
+int elf_map(const char* path, vm_space_t* vs, uint64_t* entry);
 
 #endif
 
@@ -0,0 +1,25 @@
+#ifndef FDT_H
+#define FDT_H
+
+#include "types.h"
+
+/*
+ * Minimal flattened device tree reader, enough to size memory at boot.
+ * The firmware passes the blob's address in a1 at _start.
+ */
+
+typedef void (*fdt_region_fn)(uint64_t base, uint64_t size, void* arg);
+
+/* Check the header; returns 0 if dtb is a usable blob */
+int fdt_init(const void* dtb);
+
+/* Size of the blob in bytes (0 before a successful fdt_init) */
+uint32_t fdt_total_size(void);
+
+/* Call fn for every reg range of the /memory nodes */
+int fdt_memory(fdt_region_fn fn, void* arg);
+
+/* Call fn for every memory reservation entry and /reserved-memory child */
+int fdt_reserved(fdt_region_fn fn, void* arg);
+
+#endif
@@ -3,32 +3,63 @@
 
 #include "types.h"
 
-#define FS_MAGIC 0x4F534653  /* "OSFS" */
+#define FS_MAGIC 0x4F534632  /* "OSF2" (compact record layout) */
 #define MAX_FILENAME 256
 #define MAX_FILES 64
 #define FS_BLOCKS 2048
 
+/* Names live in a string heap after the bitmap, so the record table
+ * stays small enough to scan in a few cache lines. It holds MAX_FILES
+ * names of the longest length, so names never run out before records. */
+#define FS_NAME_HEAP_SIZE (MAX_FILES * (MAX_FILENAME + 1))
+
+/* Fixed-size file record: 32 bytes, two per 64-byte cache line */
 typedef struct {
-    char name[MAX_FILENAME];
+    uint32_t name_hash;    /* FNV-1a hash of the name, compared first */
+    uint32_t name_off;     /* Offset of the name in the name heap */
     uint32_t size;
     uint32_t start_block;
     uint32_t blocks;
-    uint8_t type;  /* 0 = file, 1 = dir */
+    uint16_t name_len;     /* Length without the null terminator */
+    uint8_t type;          /* 0 = file, 1 = dir */
+    uint8_t reserved0;
+    uint32_t gen;          /* Bumped whenever the contents change */
+    uint32_t reserved;
 } file_entry_t;
 
 typedef struct {
     uint32_t magic;
     uint32_t num_files;
+    uint32_t name_heap_used;
+    uint32_t next_gen;     /* Source of file generation numbers */
     file_entry_t files[MAX_FILES];
     uint8_t block_bitmap[FS_BLOCKS / 8];
+    char name_heap[FS_NAME_HEAP_SIZE];
 } fs_superblock_t;
 
+/* Directory entry as packed by fs_readdir: a fixed header followed by
+ * the null-terminated name, padded so the next entry is 8-byte aligned. */
+typedef struct {
+    uint32_t size;         /* File size in bytes */
+    uint16_t reclen;       /* Bytes from this entry to the next one */
+    uint8_t type;          /* 0 = file, 1 = dir */
+    uint8_t name_len;
+    char name[];
+} fs_dirent_t;
+
+#define FS_DIRENT_RECLEN(name_len) \
+    ((sizeof(fs_dirent_t) + (name_len) + 1 + 7) & ~(size_t)7)
+
 int fs_init(void);
 int fs_create_file(const char* name, uint32_t size);
 int fs_read_file(const char* name, void* buf, uint32_t size, uint32_t offset);
+int fs_read_entry(const file_entry_t* entry, void* buf, uint32_t size, uint32_t offset);
 int fs_write_file(const char* name, const void* buf, uint32_t size, uint32_t offset);
 int fs_list_files(char* buf, size_t buf_size);
+int fs_readdir(uint32_t* cursor, void* buf, size_t buf_size);
 file_entry_t* fs_find_file(const char* name);
+const char* fs_entry_name(const file_entry_t* entry);
+uint32_t fs_entry_ino(const file_entry_t* entry);
+const void* fs_entry_data(const file_entry_t* entry);
 
 #endif
-
@@ -0,0 +1,49 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include "types.h"
+
+/*
+ * Log2 histogram: bucket 0 counts zeros and bucket i counts values in
+ * [2^(i-1), 2^i). Percentiles are reported as the upper bound of the
+ * bucket they fall in, capped at the largest value seen.
+ */
+#define HIST_BUCKETS 32
+
+typedef struct {
+    uint64_t count;
+    uint64_t max;
+    uint32_t buckets[HIST_BUCKETS];
+} hist_t;
+
+static inline void hist_add(hist_t* h, uint64_t v) {
+    int b = v ? 64 - __builtin_clzll(v) : 0;
+    if (b >= HIST_BUCKETS) {
+        b = HIST_BUCKETS - 1;
+    }
+    h->buckets[b]++;
+    h->count++;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+/* Value below which pct percent of the samples fall (0 if empty) */
+static inline uint64_t hist_percentile(const hist_t* h, uint32_t pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (h->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t upper = b ? (1UL << b) - 1 : 0;
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+
+#include "types.h"
+
+/*
+ * Cache of read-only executable pages shared between tasks.
+ * A page is identified by the file's inode and generation numbers and
+ * the file offset of the page start. Each mapping holds a reference;
+ * the page is freed when the last one is dropped.
+ */
+typedef struct {
+    uint32_t ino;
+    uint32_t gen;
+    uint32_t offset;
+} imgcache_key_t;
+
+void imgcache_init(void);
+
+/* Take a reference to a cached page, or NULL on a miss */
+void* imgcache_lookup(const imgcache_key_t* key);
+
+/* Take another reference to page if it is the one cached under key;
+ * returns -1 otherwise */
+int imgcache_get(const imgcache_key_t* key, void* page);
+
+/* Add a freshly filled page holding one reference. Returns the page
+ * that is now cached under key, or NULL if the cache is full. */
+void* imgcache_insert(const imgcache_key_t* key, void* page);
+
+/* Drop a reference; returns -1 if page is not cached under key */
+int imgcache_put(const imgcache_key_t* key, void* page);
+
+void imgcache_stats(uint64_t* hits, uint64_t* misses, int* pages);
+
+#endif
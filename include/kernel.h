@@ -12,6 +12,16 @@
 #define MAX_TASKS 32
 #define TASK_NAME_LEN 32
 
+/* Harts */
+#define MAX_HARTS 8             /* Size of per-hart tables */
+extern uint32_t boot_hartid;
+
+/* Only the boot hart enters the kernel so far, so this is the hart id
+ * kernel_main was started with */
+static inline uint32_t current_hart(void) {
+    return boot_hartid;
+}
+
 /* File system */
 #define MAX_FILES 64
 #define MAX_FILENAME 256
@@ -29,6 +39,14 @@
 #define SYS_CLOSE 8
 #define SYS_READ_FS 9
 #define SYS_WRITE_FS 10
+#define SYS_READDIR 11
+#define SYS_SPAWN 12
+#define SYS_GETPID 13
+#define SYS_URING_SETUP 14
+#define SYS_URING_ENTER 15
+#define SYS_PERF_READ 16
+#define SYS_SCHED_LATENCY 17
+#define NR_SYSCALLS 18
 
 /* Privilege levels */
 #define MACHINE_MODE 3
@@ -0,0 +1,40 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "types.h"
+
+/*
+ * Kernel log. printf formats into a per-hart buffer and appends the
+ * text to a global ring of fixed-size records, each stamped with a
+ * sequence number, the time CSR and the hart. Slots are claimed with an
+ * atomic increment, so writers never take a lock or wait on the UART.
+ * The klogd task drains new records to the console.
+ */
+#define LOG_SLOTS     512
+#define LOG_TEXT      108
+#define LOG_LINE_MAX  256   /* Per-hart formatting buffer */
+
+typedef struct {
+    uint64_t seq;           /* Written last; 0 while the slot is being filled */
+    uint64_t ticks;
+    uint16_t len;
+    uint16_t hart;
+    char text[LOG_TEXT];
+} log_record_t;
+
+/* The calling hart's formatting buffer */
+char* log_hart_buffer(size_t* size);
+
+/* Append text to the ring (split over several records if long) */
+void log_write(const char* text, size_t len);
+
+/* Write every committed record not yet shown to the console */
+void log_flush(void);
+
+/* Start the drain task; until then (and after a panic) writers flush */
+void log_start_drain(void);
+
+/* Print the records still in the ring with their timestamps (dmesg) */
+void log_dump(void);
+
+#endif
@@ -3,11 +3,19 @@
 
 #include "types.h"
 
-void memory_init(void);
+void memory_init(const void* dtb);
 void* kmalloc(size_t size);
 void kfree(void* ptr);
 void* get_free_page(void);
 void free_page(void* page);
+void page_ref_get(void* page);
+int page_ref_count(void* page);
+
+/* Carve a page-aligned physical range out of unused RAM (0 if none) */
+void* memory_alloc_region(size_t size);
+
+/* End of the highest usable RAM range found at boot */
+uint64_t memory_ram_end(void);
 
 #endif
 
@@ -3,8 +3,58 @@
 
 #include "types.h"
 
+/* Sv39 page table entry bits */
+#define PTE_V (1UL << 0)
+#define PTE_R (1UL << 1)
+#define PTE_W (1UL << 2)
+#define PTE_X (1UL << 3)
+#define PTE_U (1UL << 4)
+#define PTE_G (1UL << 5)
+#define PTE_A (1UL << 6)
+#define PTE_D (1UL << 7)
+#define PTE_COW (1UL << 8)   /* Software bit: write fault copies the page */
+#define PTE_FLAGS_MASK 0x3FFUL
+
+#define PTE_PPN_SHIFT 10
+#define PA_TO_PTE(pa)  ((((uint64_t)(pa)) >> 12) << PTE_PPN_SHIFT)
+#define PTE_TO_PA(pte) (((pte) >> PTE_PPN_SHIFT) << 12)
+
+#define SATP_MODE_SV39 (8UL << 60)
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK (0xFFFFUL << SATP_ASID_SHIFT)
+#define SATP_PPN_MASK  ((1UL << 44) - 1)
+#define MAKE_SATP(root) (SATP_MODE_SV39 | (((uint64_t)(root)) >> 12))
+#define SATP_ASID(satp) (((satp) & SATP_ASID_MASK) >> SATP_ASID_SHIFT)
+#define SATP_ROOT(satp) (((satp) & SATP_PPN_MASK) << 12)
+
+/*
+ * Address space layout (each root slot covers 1GB):
+ *   slot 0      0x00000000 - 0x3FFFFFFF  MMIO, kernel only, 2MB megapages
+ *   slot 1      0x40000000 - 0x7FFFFFFF  user window, private per task
+ *   slots 2+    0x80000000 -             RAM direct map, 1GB gigapages,
+ *                                        as many as the device tree's RAM needs
+ * Every slot except the user window is shared with the kernel table.
+ */
+#define USER_BASE      0x40000000UL
+#define USER_TOP       0x80000000UL
+#define USER_STACK_TOP USER_TOP
+
+typedef uint64_t pte_t;
+
 void paging_init(void);
 void* setup_page_table(void);
+void paging_free_table(void* root);
+void paging_switch(uint64_t satp);
+void paging_activate(uint64_t* satp, uint64_t* asid_gen);
+int paging_set_asid_enabled(int enabled);
+uint64_t paging_kernel_satp(void);
+void* paging_kernel_root(void);
 
-#endif
+/* 4KB mappings in a task page table */
+int paging_map(pte_t* root, uint64_t va, uint64_t pa, uint64_t flags);
+uint64_t paging_unmap(pte_t* root, uint64_t va, uint64_t satp);
+pte_t* paging_walk(pte_t* root, uint64_t va, int alloc);
+void paging_flush_page(uint64_t va, uint64_t satp);
+void paging_flush_asid(uint64_t satp);
 
+#endif
@@ -0,0 +1,38 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "types.h"
+
+/*
+ * Per-task performance counters. The hart's cycle and instret counters
+ * (started through the SBI PMU extension) run freely; each task owns
+ * the deltas between being switched in and out, so the counts are
+ * virtualized without reprogramming hardware on every switch.
+ */
+typedef struct {
+    uint64_t cycles;
+    uint64_t instret;
+    uint64_t faults;        /* Page faults taken while the task ran */
+} perf_counts_t;
+
+typedef struct {
+    perf_counts_t total;    /* Up to the last switch out */
+    uint64_t cycle_mark;    /* Counter values at the last switch in */
+    uint64_t instret_mark;
+} perf_task_t;
+
+struct task;
+
+/* Start cycle/instret through SBI if the firmware has the PMU extension,
+ * then mark the running task; call after task_init */
+void perf_init(void);
+
+/* Charge prev up to now and start charging next; either may be NULL */
+void perf_switch(struct task* prev, struct task* next);
+
+/* Counts for t so far, including its current run if it is running */
+void perf_read(struct task* t, perf_counts_t* out);
+
+void perf_count_fault(struct task* t);
+
+#endif
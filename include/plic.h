@@ -0,0 +1,40 @@
+#ifndef PLIC_H
+#define PLIC_H
+
+#include "types.h"
+
+#define PLIC_BASE 0x0C000000UL
+
+/* QEMU virt interrupt sources */
+#define UART_IRQ   10
+#define VIRTIO_IRQ 1    /* First of eight VirtIO MMIO slots */
+
+#define PLIC_NUM_IRQS 128
+#define PLIC_MAX_HARTS 8
+
+typedef void (*irq_handler_t)(uint32_t irq, void* arg);
+
+/* Global setup: every source masked at priority 0 */
+void plic_init(void);
+
+/* Per-hart setup, run by each hart entering the kernel: threshold 0,
+ * external interrupts on, and the hart becomes a routing target */
+void plic_hart_init(uint32_t hartid);
+
+/*
+ * Route irq to handler. The source goes to the online hart with the
+ * fewest sources so device interrupts spread across harts. Returns the
+ * hart chosen, or -1.
+ */
+int plic_register(uint32_t irq, uint32_t priority, irq_handler_t fn, void* arg);
+
+void plic_set_priority(uint32_t irq, uint32_t priority);
+void plic_set_threshold(uint32_t hartid, uint32_t threshold);
+
+/* Claim and handle every pending source for this hart */
+void plic_dispatch(void);
+
+/* Per-source routing and counts (shell command "irqs") */
+void plic_dump(void);
+
+#endif
@@ -1,10 +1,26 @@
 #ifndef PRINTF_H
 #define PRINTF_H
 
+#include "types.h"
+
+typedef __builtin_va_list va_list;
+#define va_start(ap, last) __builtin_va_start(ap, last)
+#define va_end(ap) __builtin_va_end(ap)
+#define va_arg(ap, type) __builtin_va_arg(ap, type)
+
 /* Simple kernel printf interface.
  * Implementation is in kernel/printf.c
+ *
+ * Conversions: %d %i %u %x %p %s %c %%, with an optional l/ll size,
+ * a 0 flag and a field width. %x and %p print a 0x prefix.
  */
 
-int kprintf(const char *fmt, ...);
+/* Format into buf (always NUL-terminated if size > 0); returns the
+ * length the full output would have had */
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int snprintf(char* buf, size_t size, const char* fmt, ...);
+
+/* Format, then hand the result to the kernel log in one write */
+int printf(const char* fmt, ...);
 
 #endif
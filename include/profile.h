@@ -0,0 +1,46 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+#include "trap.h"
+
+/*
+ * Sampling profiler. While running, the S-mode timer interrupt fires at
+ * the chosen rate and each tick records the interrupted pc plus a short
+ * frame-pointer backtrace into a histogram of unique stacks.
+ */
+#define PROFILE_DEPTH       8       /* pc + up to 7 return addresses */
+#define PROFILE_SLOTS       1024    /* Unique stacks, a power of two */
+#define PROFILE_HZ_DEFAULT  1000
+#define PROFILE_HZ_MAX      10000
+
+typedef struct {
+    uint64_t pc[PROFILE_DEPTH];
+    uint32_t count;
+    uint16_t depth;                 /* 0 = free slot */
+    uint16_t user;                  /* Sampled in user mode: pc only */
+} profile_slot_t;
+
+/* Clear the histogram and start sampling hz times a second */
+int profile_start(uint32_t hz);
+void profile_stop(void);
+int profile_active(void);
+
+/* Print the histogram between BEGIN/END markers for tools/profile2sym.py */
+void profile_dump(void);
+
+/* Timer interrupt hook: record tf and arm the next tick */
+void profile_sample(trapframe_t* tf);
+
+/*
+ * While profiling, kernel code runs with sstatus.SIE set so the timer
+ * can sample it; device interrupts stay masked in sie outside the
+ * scheduler's windows. Called on kernel entry from a syscall or fault.
+ */
+static inline void profile_unmask(void) {
+    if (profile_active()) {
+        asm volatile("csrs sstatus, %0" :: "r"(SSTATUS_SIE));
+    }
+}
+
+#endif
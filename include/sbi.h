@@ -0,0 +1,39 @@
+#ifndef SBI_H
+#define SBI_H
+
+#include "types.h"
+
+/*
+ * Calls into the SBI firmware (OpenSBI) with ecall. Extensions are
+ * identified by EID; each returns an error code and a value in a0/a1.
+ */
+#define SBI_EXT_LEGACY_SET_TIMER 0x00
+#define SBI_EXT_BASE             0x10
+#define SBI_EXT_TIME             0x54494D45  /* "TIME" */
+#define SBI_EXT_PMU              0x504D55    /* "PMU" */
+
+/* PMU extension: counters 0-2 are cycle, time and instret */
+#define SBI_PMU_NUM_COUNTERS       0
+#define SBI_PMU_COUNTER_CFG_MATCH  2
+#define SBI_PMU_CFG_AUTO_START     (1UL << 2)
+#define SBI_PMU_HW_CPU_CYCLES      1         /* Event type 0 (hardware) */
+#define SBI_PMU_HW_INSTRUCTIONS    2
+
+#define SBI_SUCCESS               0
+#define SBI_ERR_NOT_SUPPORTED    -2
+
+typedef struct {
+    long error;
+    long value;
+} sbiret_t;
+
+sbiret_t sbi_ecall(long eid, long fid, uint64_t a0, uint64_t a1,
+                   uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5);
+
+/* Nonzero if the firmware implements extension eid */
+int sbi_probe_extension(long eid);
+
+/* Raise the S-mode timer interrupt once time >= when; clears a pending one */
+void sbi_set_timer(uint64_t when);
+
+#endif
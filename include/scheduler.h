@@ -14,6 +14,11 @@ void scheduler_init(void);
  */
 void scheduler_add_task(task_t* task);
 
+/*
+ * Remove a task from the ready queue
+ */
+void scheduler_remove_task(task_t* task);
+
 /*
  * Pop the next runnable task
  */
@@ -30,4 +35,29 @@ task_t* scheduler_get_task_list(void);
  */
 void scheduler_yield(void);
 
+/*
+ * Yield from the timer interrupt (counted as an involuntary switch)
+ */
+void scheduler_preempt(void);
+
+/*
+ * Wakeup-to-run latency: time from scheduler_add_task to dispatch
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} sched_latency_t;
+
+/*
+ * Summarize the histogram of a task, or of this hart if task is NULL
+ */
+void scheduler_latency(const task_t* task, sched_latency_t* out);
+
+/*
+ * Clear every task's and hart's histogram
+ */
+void scheduler_latency_reset(void);
+
 #endif
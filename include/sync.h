@@ -21,6 +21,11 @@ typedef struct {
     struct task* wait_queue;
 } mutex_t;
 
+/* Tasks blocked until an event (e.g. UART input) wakes them */
+typedef struct {
+    struct task* head;
+} wait_queue_t;
+
 void spinlock_init(spinlock_t* lock);
 void spinlock_lock(spinlock_t* lock);
 void spinlock_unlock(spinlock_t* lock);
@@ -33,5 +38,10 @@ void mutex_init(mutex_t* mutex);
 void mutex_lock(mutex_t* mutex);
 void mutex_unlock(mutex_t* mutex);
 
+void wait_queue_init(wait_queue_t* wq);
+void wait_queue_sleep(wait_queue_t* wq);
+void wait_queue_wake_all(wait_queue_t* wq);
+void wait_queue_remove(wait_queue_t* wq, struct task* task);
+
 #endif
 
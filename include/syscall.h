@@ -0,0 +1,20 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "types.h"
+#include "trap.h"
+
+#define SYSCALL_ARGS 6
+
+/* Handlers receive a0..a5; for user ecalls this points into the trap frame */
+typedef uint64_t (*syscall_fn_t)(const uint64_t* args);
+
+uint64_t syscall_handler(uint64_t syscall_num, const uint64_t* args);
+
+/* User ecall entry, called straight from boot/trap.S */
+trapframe_t* syscall_entry(trapframe_t* tf);
+
+/* Run the ecall saved in tf; syscall_entry adds the trap accounting */
+void syscall_dispatch(trapframe_t* tf);
+
+#endif
@@ -3,6 +3,15 @@
 
 #include "types.h"
 #include "sync.h"
+#include "vm.h"
+#include "trap.h"
+#include "perf.h"
+#include "hist.h"
+
+/* Arguments copied onto a new program's stack: pointers plus strings
+ * must fit in its top stack page */
+#define TASK_MAX_ARGS 16
+#define TASK_ARG_LEN  128
 
 /* Max length of a task name (including null terminator) */
 #ifndef TASK_NAME_LEN
@@ -10,27 +19,55 @@
 #endif
 
 typedef enum {
+    TASK_UNUSED,            /* Free slot in the task table */
     TASK_RUNNING,
     TASK_READY,
     TASK_BLOCKED,
     TASK_ZOMBIE
 } task_state_t;
 
+/* Callee-saved registers of a kernel thread (see boot/switch.S) */
+typedef struct {
+    uint64_t ra;
+    uint64_t sp;
+    uint64_t s[12];
+} context_t;
+
+/* Per-task accounting; run time and faults are in perf_task_t */
+typedef struct {
+    uint64_t vol_switches;      /* Gave up the CPU: blocked, yielded, exited */
+    uint64_t invol_switches;    /* Preempted by the timer */
+    uint64_t syscalls;
+    uint64_t bytes_read;        /* Console and file system */
+    uint64_t bytes_written;
+} task_acct_t;
+
 typedef struct task {
-    uint64_t regs[32];      /* RISC-V registers */
-    uint64_t pc;            /* Program counter */
-    uint64_t sp;            /* Stack pointer */
-    uint64_t satp;          /* Page table register */
+    trapframe_t tf;         /* User registers, saved on trap entry */
+    context_t ctx;          /* Kernel registers, saved on context switch */
+    uint64_t pc;            /* Kernel entry point */
+    uint64_t sp;            /* Kernel stack pointer */
+    uint64_t satp;          /* Page table register (root and ASID) */
+    uint64_t asid_gen;      /* ASID generation the satp ASID belongs to */
     task_state_t state;
     int pid;
     int ppid;
     char name[TASK_NAME_LEN];
     void* stack;
     void* page_table;
+    vm_space_t vm;          /* Mapped segments, faulted in on demand */
     struct task* next;
     struct task* prev;
+    struct task* rq_next;   /* Scheduler ready queue link */
+    struct task* wait_next; /* Wait queue link while blocked */
+    wait_queue_t* waiting_on;
     mutex_t* wait_mutex;
     int exit_code;
+    perf_task_t perf;       /* Cycles, instructions, faults (kernel/perf.c) */
+    task_acct_t acct;
+    uint64_t ready_ticks;   /* When it was created or woken, 0 once dispatched */
+    int background;         /* Queued behind every other ready task */
+    hist_t sched_lat;       /* Ready-to-dispatch delay, time CSR ticks */
 } task_t;
 
 /* Task API */
@@ -40,10 +77,19 @@ void task_yield(void);
 task_t* get_current_task(void);
 int task_fork(void);
 int task_exec(const char* path, char** argv);
+int task_spawn(const char* path, char** argv);
+int task_load_image(task_t* task, const char* path, char** argv);
+void task_setup_user(task_t* task, uint64_t entry, uint64_t user_sp);
+task_t* task_find(int pid);
+task_t* task_at(int slot);  /* Slot of the task table, NULL if unused */
+const char* task_state_name(task_state_t state);
+int task_kill(int pid);
 int task_wait(int pid);
+int task_wait_perf(int pid, perf_counts_t* counts);
 
 /* Initialization and internal helpers */
 void task_init(void);
 void set_current_task(task_t* task);
+void context_switch(context_t* old, context_t* new);
 
 #endif
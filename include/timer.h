@@ -4,7 +4,16 @@
 #include "types.h"
 
 void timer_init();
-void timer_tick();
+int timer_tick();
 uint64_t timer_get_ticks();
+uint64_t timer_ticks_to_us(uint64_t ticks);
+uint64_t timer_get_freq(void);
+void timer_set_wall_ns(uint64_t ns);
+
+/* Also interrupt at this time for the profiler (~0UL: no sample due) */
+void timer_set_sample(uint64_t when);
+
+/* Page holding the clock_page_t mapped into tasks (NULL before init) */
+void* timer_clock_page(void);
 
 #endif
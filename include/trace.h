@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+/*
+ * Static tracepoints. Built with CONFIG_TRACE (make TRACE=1), each
+ * TRACE() appends a fixed-size binary event stamped with the time CSR
+ * to the calling hart's ring; the oldest events are overwritten. Without
+ * it TRACE() expands to nothing and its arguments are not evaluated.
+ */
+#define TRACE_EVENTS  4096          /* Per-hart ring, a power of two */
+#define TRACE_MAGIC   0x31435254    /* "TRC1" little-endian */
+
+typedef enum {
+    TRACE_SCHED_SWITCH = 1,         /* arg0 = previous pid, arg1 = next pid */
+    TRACE_TASK_CREATE,              /* arg0 = pid, arg1 = parent pid */
+    TRACE_TASK_EXIT,                /* arg0 = pid, arg1 = exit code */
+    TRACE_KMALLOC,                  /* arg0 = size, arg1 = pointer */
+    TRACE_KFREE,                    /* arg0 = pointer */
+    TRACE_FS_READ_BEGIN,            /* arg0 = size, arg1 = offset */
+    TRACE_FS_READ_END,              /* arg0 = result */
+    TRACE_FS_WRITE_BEGIN,           /* arg0 = size, arg1 = offset */
+    TRACE_FS_WRITE_END,             /* arg0 = result */
+    TRACE_ELF_LOAD_BEGIN,
+    TRACE_ELF_LOAD_END,             /* arg0 = result, arg1 = entry */
+    TRACE_TRAP_ENTER,               /* arg0 = scause, arg1 = sepc */
+    TRACE_TRAP_EXIT,                /* arg0 = scause */
+    TRACE_SYSCALL_ENTER,            /* arg0 = number */
+    TRACE_SYSCALL_EXIT,             /* arg0 = number, arg1 = result */
+} trace_id_t;
+
+typedef struct {
+    uint64_t ticks;
+    uint16_t id;
+    uint16_t hart;
+    uint32_t pid;
+    uint64_t arg0;
+    uint64_t arg1;
+} trace_event_t;
+
+/* Saved files and console dumps start with this header */
+typedef struct {
+    uint32_t magic;
+    uint16_t event_size;
+    uint16_t hart;
+    uint64_t freq;                  /* time CSR ticks per second */
+    uint64_t count;                 /* Events that follow, oldest first */
+} trace_header_t;
+
+#ifdef CONFIG_TRACE
+#define TRACE(id, a0, a1) trace_event((id), (uint64_t)(a0), (uint64_t)(a1))
+#else
+#define TRACE(id, a0, a1) do { } while (0)
+#endif
+
+/* Allocate the ring for a hart; events before this are not recorded */
+void trace_hart_init(uint32_t hartid);
+
+void trace_event(uint16_t id, uint64_t arg0, uint64_t arg1);
+
+/* Drop every recorded event */
+void trace_clear(void);
+
+/* Write the ring to the console as hex between BEGIN/END markers */
+void trace_dump(void);
+
+/* Write the ring to a file; returns bytes written or -1 */
+int trace_save(const char* name);
+
+#endif
@@ -3,7 +3,56 @@
 
 #include "types.h"
 
+/*
+ * Registers saved on trap entry. Traps from user mode save into the
+ * current task's frame (task_t.tf, found through sscratch); traps taken
+ * in the kernel push a frame on the current kernel stack.
+ * boot/trap.S hard-codes these offsets.
+ */
+typedef struct trapframe {
+    uint64_t regs[32];      /* x0..x31 */
+    uint64_t sepc;
+    uint64_t sstatus;
+    uint64_t scause;
+    uint64_t stval;
+    uint64_t kernel_sp;     /* Kernel stack top used for traps from user mode */
+} trapframe_t;
+
+#define SSTATUS_SPP  (1UL << 8)
+#define SSTATUS_SPIE (1UL << 5)
+#define SSTATUS_SIE  (1UL << 1)
+#define SSTATUS_SUM  (1UL << 18)
+
+#define SIE_STIE     (1UL << 5)
+#define SIE_SEIE     (1UL << 9)
+
+#define SCAUSE_INTERRUPT (1UL << 63)
+#define TRAP_CAUSES 16
+
+/* Interrupt causes */
+#define IRQ_S_SOFT  1
+#define IRQ_S_TIMER 5
+#define IRQ_S_EXT   9
+
+/* Exception causes */
+#define EXC_ECALL_U         8
+#define EXC_INST_PAGE_FAULT 12
+#define EXC_LOAD_PAGE_FAULT 13
+#define EXC_STORE_PAGE_FAULT 15
+
+typedef void (*trap_fn_t)(trapframe_t* tf);
+
+typedef struct {
+    uint64_t count;
+    uint64_t max_cycles;    /* Slowest handler run */
+} trap_stat_t;
+
 void trap_init();
-void trap_handler(uint64_t cause, uint64_t epc);
+trapframe_t* trap_handler(trapframe_t* tf);
+void trap_dump_stats(void);
+
+/* Per-cause accounting for paths that bypass trap_handler */
+uint64_t trap_stat_start(void);
+void trap_stat_end(int is_irq, uint64_t code, uint64_t start);
 
 #endif
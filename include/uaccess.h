@@ -0,0 +1,22 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include "types.h"
+
+/*
+ * Copies between the kernel and the current task's user memory. The
+ * range is checked against the task's areas first; faults while
+ * copying are caught through the fixup table instead of crashing.
+ * Return 0 on success and -1 for a bad address.
+ */
+int copy_from_user(void* dst, const void* user_src, size_t n);
+int copy_to_user(void* user_dst, const void* src, size_t n);
+
+/* Copy a NUL-terminated string of at most max - 1 characters.
+ * Returns its length, or -1 for a bad address or a longer string. */
+long strncpy_from_user(char* dst, const char* user_src, size_t max);
+
+/* Fixup pc for a faulting kernel pc, or 0 if it has none */
+uint64_t uaccess_fixup(uint64_t epc);
+
+#endif
@@ -8,7 +8,15 @@
 void uart_init(void);
 void uart_putchar(char c);
 char uart_getchar(void);
+int uart_trygetchar(void);  /* -1 if nothing has been received */
 void uart_puts(const char* s);
+void uart_write(const char* s, size_t len);
+
+/* Wait until queued output has reached the device */
+void uart_flush(void);
+
+/* Interrupt handler, registered for UART_IRQ */
+void uart_intr(uint32_t irq, void* arg);
 
 #endif
 
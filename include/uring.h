@@ -0,0 +1,47 @@
+#ifndef URING_H
+#define URING_H
+
+#include "types.h"
+#include "kernel.h"
+#include "paging.h"
+
+/*
+ * Submission/completion ring shared between a task and the kernel.
+ * SYS_URING_SETUP maps one page at URING_BASE holding the header and
+ * both rings. The task fills SQEs and advances sq_tail, then a single
+ * SYS_URING_ENTER runs every pending request; results appear as CQEs
+ * that the task reads by polling cq_tail, without another trap.
+ * Indices run freely and are masked with URING_ENTRIES - 1.
+ */
+#define URING_ENTRIES 64
+#define URING_BASE    (USER_STACK_TOP - USER_STACK_SIZE - 2 * PAGE_SIZE)
+
+/* Submission: a syscall number and its first three arguments */
+typedef struct {
+    uint32_t op;            /* SYS_WRITE, SYS_READ_FS, SYS_WRITE_FS, SYS_GETPID */
+    uint32_t flags;         /* Unused, must be 0 */
+    uint64_t args[3];
+    uint64_t user_data;     /* Copied to the completion */
+} uring_sqe_t;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t result;         /* Syscall return value, -1 for a bad op */
+} uring_cqe_t;
+
+typedef struct {
+    uint32_t sq_head;       /* Written by the kernel */
+    uint32_t sq_tail;       /* Written by the task */
+    uint32_t cq_head;       /* Written by the task */
+    uint32_t cq_tail;       /* Written by the kernel */
+    uring_sqe_t sqes[URING_ENTRIES];
+    uring_cqe_t cqes[URING_ENTRIES];
+} uring_t;
+
+/* Map the ring into the current task; returns its user address or -1 */
+int64_t uring_setup(void);
+
+/* Run up to to_submit queued requests; returns how many were consumed */
+int64_t uring_enter(uint32_t to_submit);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef VM_H
+#define VM_H
+
+#include "types.h"
+#include "fs.h"
+
+struct task;  /* Forward declaration */
+
+#define VM_MAX_AREAS 8
+
+/* Area permissions (same bit values as the ELF PF_* flags) */
+#define VM_EXEC  0x1
+#define VM_WRITE 0x2
+#define VM_READ  0x4
+
+/*
+ * A mapped range of a task's address space. Bytes in
+ * [start, file_end) come from the file, bytes in [file_end, end)
+ * are zero-filled on demand (BSS).
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t file_end;
+    uint32_t file_offset;        /* File offset backing start */
+    uint32_t flags;
+    uint32_t ino;                /* Inode and generation of file at map time */
+    uint32_t gen;
+    const file_entry_t* file;    /* NULL for anonymous memory */
+} vm_area_t;
+
+typedef struct {
+    vm_area_t areas[VM_MAX_AREAS];
+    int num_areas;
+} vm_space_t;
+
+void vm_space_init(vm_space_t* vs);
+int vm_map_file(vm_space_t* vs, uint64_t start, uint64_t memsz,
+                const file_entry_t* file, uint32_t offset, uint64_t filesz,
+                uint32_t flags);
+vm_area_t* vm_find_area(vm_space_t* vs, uint64_t addr);
+
+/* Resolve a fault at addr for the given access (VM_READ/VM_WRITE/VM_EXEC).
+ * Returns 0 when the page is now present, -1 for a bad access. */
+int vm_handle_fault(struct task* task, uint64_t addr, uint32_t access);
+
+/* Map a page the caller filled at va, with the flags of the areas there */
+int vm_map_page(struct task* task, uint64_t va, void* page);
+
+/* Share the parent's mappings with child, copy-on-write */
+int vm_space_fork(struct task* parent, struct task* child);
+
+/* Unmap every page of every area and drop the areas */
+void vm_space_release(struct task* task);
+
+#endif
@@ -0,0 +1,184 @@
+#include "bench.h"
+#include "paging.h"
+#include "memory.h"
+#include "task.h"
+#include "scheduler.h"
+#include "trap.h"
+#include "kernel.h"
+#include "string.h"
+#include "printf.h"
+#include "types.h"
+
+#define TLB_BENCH_SPACES 2
+#define TLB_BENCH_PAGES  32
+#define TLB_BENCH_ROUNDS 2000
+
+#define SPAWN_BENCH_ROUNDS 16
+
+#define SYSCALL_BENCH_ROUNDS 1000
+
+/*
+ * User program for the null syscall benchmark: SYSCALL_BENCH_ROUNDS
+ * getpid calls, then exit with the cycles they took.
+ */
+static const uint32_t null_syscall_code[] = {
+    0xc0002473,  /* rdcycle s0 */
+    0x3e800493,  /* li s1, 1000 */
+    0x00d00893,  /* 1: li a7, SYS_GETPID */
+    0x00000073,  /* ecall */
+    0xfff48493,  /* addi s1, s1, -1 */
+    0xfe049ae3,  /* bnez s1, 1b */
+    0xc0002573,  /* rdcycle a0 */
+    0x40850533,  /* sub a0, a0, s0 */
+    0x00100893,  /* li a7, SYS_EXIT */
+    0x00000073,  /* ecall */
+};
+
+/* Switch between the spaces, touching every page after each switch */
+static uint64_t tlb_switch_rounds(uint64_t* satp, uint64_t* gen) {
+    uint64_t start = bench_cycles();
+
+    for (int r = 0; r < TLB_BENCH_ROUNDS; r++) {
+        int s = r % TLB_BENCH_SPACES;
+        paging_activate(&satp[s], &gen[s]);
+
+        for (int i = 0; i < TLB_BENCH_PAGES; i++) {
+            (void)*(volatile uint64_t*)(USER_BASE + i * PAGE_SIZE);
+        }
+    }
+
+    return bench_cycles() - start;
+}
+
+void bench_tlb_switch(void) {
+    pte_t* roots[TLB_BENCH_SPACES];
+    uint64_t satp[TLB_BENCH_SPACES];
+    uint64_t gen[TLB_BENCH_SPACES];
+
+    /* Build address spaces that map the same user pages */
+    for (int s = 0; s < TLB_BENCH_SPACES; s++) {
+        roots[s] = setup_page_table();
+        if (!roots[s]) {
+            printf("bench: out of memory\r\n");
+            return;
+        }
+        satp[s] = MAKE_SATP(roots[s]);
+        gen[s] = 0;
+
+        for (int i = 0; i < TLB_BENCH_PAGES; i++) {
+            void* page = get_free_page();
+            if (!page) {
+                printf("bench: out of memory\r\n");
+                return;
+            }
+            paging_map(roots[s], USER_BASE + i * PAGE_SIZE, (uint64_t)page,
+                       PTE_R | PTE_W | PTE_U | PTE_A | PTE_D);
+        }
+    }
+
+    /* Kernel reads of U pages need SUM */
+    asm volatile("csrs sstatus, %0" :: "r"(SSTATUS_SUM));
+
+    int asids = paging_set_asid_enabled(1);
+    uint64_t tagged = tlb_switch_rounds(satp, gen);
+    paging_set_asid_enabled(0);
+    uint64_t flushed = tlb_switch_rounds(satp, gen);
+    paging_set_asid_enabled(asids);
+
+    asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_SUM));
+
+    /* Back to the caller's table before tearing the spaces down */
+    task_t* cur = get_current_task();
+    paging_activate(&cur->satp, &cur->asid_gen);
+
+    for (int s = 0; s < TLB_BENCH_SPACES; s++) {
+        for (int i = 0; i < TLB_BENCH_PAGES; i++) {
+            uint64_t pa = paging_unmap(roots[s], USER_BASE + i * PAGE_SIZE, satp[s]);
+            free_page((void*)pa);
+        }
+        paging_free_table(roots[s]);
+    }
+
+    printf("TLB switch benchmark: %d switches, %d pages touched per switch\r\n",
+           TLB_BENCH_ROUNDS, TLB_BENCH_PAGES);
+    if (!asids) {
+        printf("  (hart has no ASIDs; both runs flush)\r\n");
+    }
+    printf("  ASID-tagged: %lu cycles/switch\r\n", tagged / TLB_BENCH_ROUNDS);
+    printf("  full flush:  %lu cycles/switch\r\n", flushed / TLB_BENCH_ROUNDS);
+}
+
+void bench_spawn(const char* path) {
+    uint64_t spawn_cycles = 0;
+    uint64_t fork_exec_cycles = 0;
+
+    for (int r = 0; r < SPAWN_BENCH_ROUNDS; r++) {
+        uint64_t start = bench_cycles();
+        int pid = task_spawn(path, NULL);
+        spawn_cycles += bench_cycles() - start;
+
+        if (pid < 0) {
+            printf("bench: cannot spawn %s\r\n", path);
+            return;
+        }
+        task_kill(pid);
+    }
+
+    for (int r = 0; r < SPAWN_BENCH_ROUNDS; r++) {
+        uint64_t start = bench_cycles();
+        int pid = task_fork();
+        task_t* child = pid < 0 ? NULL : task_find(pid);
+        int loaded = child ? task_load_image(child, path, NULL) : -1;
+        fork_exec_cycles += bench_cycles() - start;
+
+        if (pid >= 0) {
+            task_kill(pid);
+        }
+        if (loaded != 0) {
+            printf("bench: fork+exec of %s failed\r\n", path);
+            return;
+        }
+    }
+
+    printf("Spawn benchmark: %s, %d rounds\r\n", path, SPAWN_BENCH_ROUNDS);
+    printf("  spawn:      %lu cycles\r\n", spawn_cycles / SPAWN_BENCH_ROUNDS);
+    printf("  fork+exec:  %lu cycles\r\n", fork_exec_cycles / SPAWN_BENCH_ROUNDS);
+}
+
+void bench_null_syscall(void) {
+    task_t* task = task_create("nullsys", NULL);
+    if (!task) {
+        printf("bench: cannot create task\r\n");
+        return;
+    }
+
+    /* One code page at USER_BASE; the area lets exit free it */
+    void* page = get_free_page();
+    if (!page || vm_map_file(&task->vm, USER_BASE, PAGE_SIZE, NULL, 0, 0,
+                             VM_READ | VM_EXEC) != 0) {
+        printf("bench: out of memory\r\n");
+        if (page) {
+            free_page(page);
+        }
+        task_kill(task->pid);
+        return;
+    }
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, null_syscall_code, sizeof(null_syscall_code));
+    paging_map(task->page_table, USER_BASE, (uint64_t)page,
+               PTE_R | PTE_X | PTE_U | PTE_A);
+    asm volatile("fence.i");
+
+    task_setup_user(task, USER_BASE, USER_STACK_TOP);
+    scheduler_add_task(task);
+
+    int cycles = task_wait(task->pid);
+    if (cycles < 0) {
+        printf("bench: syscall task failed\r\n");
+        return;
+    }
+
+    printf("Null syscall benchmark: %d getpid calls from user mode\r\n",
+           SYSCALL_BENCH_ROUNDS);
+    printf("  ecall round trip: %d cycles\r\n", cycles / SYSCALL_BENCH_ROUNDS);
+}
@@ -1,68 +1,139 @@
 #include "elf.h"
 #include "fs.h"
-#include "memory.h"
+#include "vm.h"
 #include "string.h"
+#include "trace.h"
 #include "types.h"
 
-int elf_load(const char* path, uint64_t* entry) {
-    Elf64_Ehdr ehdr;
-    
+/* Reads use 32-bit offsets: reject ranges that do not fit in the file */
+static int elf_range_ok(const file_entry_t* file, uint64_t offset, uint64_t size) {
+    return offset <= file->size && size <= file->size - offset;
+}
+
+/*
+ * Look the file up once, validate the ELF header and read the whole
+ * program header table in one batch. Returns the number of program
+ * headers, or -1 if the file is not a loadable RISC-V ELF.
+ */
+static int elf_read_headers(const char* path, file_entry_t** file_out,
+                            Elf64_Ehdr* ehdr, Elf64_Phdr* phdrs) {
+    file_entry_t* file = fs_find_file(path);
+    if (!file) {
+        return -1;
+    }
+
     /* Read ELF header */
-    if (fs_read_file(path, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr)) {
+    if (fs_read_entry(file, ehdr, sizeof(*ehdr), 0) != sizeof(*ehdr)) {
         return -1;
     }
     
     /* Check ELF magic */
-    if (ehdr.e_ident[0] != 0x7f || 
-        ehdr.e_ident[1] != 'E' ||
-        ehdr.e_ident[2] != 'L' ||
-        ehdr.e_ident[3] != 'F') {
+    if (ehdr->e_ident[0] != 0x7f || 
+        ehdr->e_ident[1] != 'E' ||
+        ehdr->e_ident[2] != 'L' ||
+        ehdr->e_ident[3] != 'F') {
         return -1;
     }
     
     /* Check architecture */
-    if (ehdr.e_machine != 0xF3) {  /* RISC-V */
+    if (ehdr->e_machine != 0xF3) {  /* RISC-V */
+        return -1;
+    }
+
+    if (ehdr->e_phentsize != sizeof(Elf64_Phdr) || ehdr->e_phnum > ELF_MAX_PHDRS) {
+        return -1;
+    }
+
+    uint32_t phdrs_size = ehdr->e_phnum * sizeof(Elf64_Phdr);
+    if (!elf_range_ok(file, ehdr->e_phoff, phdrs_size) ||
+        fs_read_entry(file, phdrs, phdrs_size, (uint32_t)ehdr->e_phoff) != (int)phdrs_size) {
+        return -1;
+    }
+
+    /* Segment data must come from inside the file */
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD &&
+            !elf_range_ok(file, phdrs[i].p_offset, phdrs[i].p_filesz)) {
+            return -1;
+        }
+    }
+
+    *file_out = file;
+    return ehdr->e_phnum;
+}
+
+static int elf_load_segments(const char* path, uint64_t* entry) {
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr phdrs[ELF_MAX_PHDRS];
+    file_entry_t* file;
+
+    int phnum = elf_read_headers(path, &file, &ehdr, phdrs);
+    if (phnum < 0) {
         return -1;
     }
     
     *entry = ehdr.e_entry;
     
     /* Load program segments */
-    for (int i = 0; i < ehdr.e_phnum; i++) {
-        Elf64_Phdr phdr;
-        uint64_t phdr_offset = ehdr.e_phoff + i * ehdr.e_phentsize;
-        
-        if (fs_read_file(path, &phdr, sizeof(phdr), phdr_offset) != sizeof(phdr)) {
+    for (int i = 0; i < phnum; i++) {
+        Elf64_Phdr* phdr = &phdrs[i];
+
+        if (phdr->p_type != PT_LOAD) {
             continue;
         }
-        
-        if (phdr.p_type == PT_LOAD) {
-            /* Allocate memory */
-            void* vaddr = (void*)phdr.p_vaddr;
-            
-            /* Read segment data */
-            uint8_t* data = kmalloc(phdr.p_filesz);
-            if (!data) {
-                return -1;
-            }
-            
-            if (fs_read_file(path, data, phdr.p_filesz, phdr.p_offset) != (int)phdr.p_filesz) {
-                kfree(data);
-                return -1;
-            }
-            
-            /* Copy to destination */
-            memcpy(vaddr, data, phdr.p_filesz);
-            
-            /* Zero BSS */
-            if (phdr.p_memsz > phdr.p_filesz) {
-                memset((char*)vaddr + phdr.p_filesz, 0, phdr.p_memsz - phdr.p_filesz);
-            }
-            
-            kfree(data);
+
+        if (phdr->p_filesz > phdr->p_memsz) {
+            return -1;
+        }
+
+        void* vaddr = (void*)phdr->p_vaddr;
+
+        /* Read segment data straight into its destination */
+        if (fs_read_entry(file, vaddr, phdr->p_filesz, phdr->p_offset) != (int)phdr->p_filesz) {
+            return -1;
+        }
+
+        /* Zero BSS */
+        if (phdr->p_memsz > phdr->p_filesz) {
+            memset((char*)vaddr + phdr->p_filesz, 0, phdr->p_memsz - phdr->p_filesz);
         }
     }
     
     return 0;
 }
 
+int elf_load(const char* path, uint64_t* entry) {
+    TRACE(TRACE_ELF_LOAD_BEGIN, 0, 0);
+    int ret = elf_load_segments(path, entry);
+    TRACE(TRACE_ELF_LOAD_END, ret, ret == 0 ? *entry : 0);
+    return ret;
+}
+
+/* Record the PT_LOAD segments in vs without reading any segment data */
+int elf_map(const char* path, vm_space_t* vs, uint64_t* entry) {
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr phdrs[ELF_MAX_PHDRS];
+    file_entry_t* file;
+
+    int phnum = elf_read_headers(path, &file, &ehdr, phdrs);
+    if (phnum < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < phnum; i++) {
+        Elf64_Phdr* phdr = &phdrs[i];
+
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) {
+            continue;
+        }
+
+        if (vm_map_file(vs, phdr->p_vaddr, phdr->p_memsz, file,
+                        (uint32_t)phdr->p_offset, phdr->p_filesz,
+                        phdr->p_flags & (VM_READ | VM_WRITE | VM_EXEC)) != 0) {
+            return -1;
+        }
+    }
+
+    *entry = ehdr.e_entry;
+    return 0;
+}
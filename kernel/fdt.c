@@ -0,0 +1,177 @@
+#include "fdt.h"
+#include "string.h"
+#include "types.h"
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+#define FDT_MAX_DEPTH  16
+
+typedef struct {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+/* Which reg properties a walk reports */
+enum { WALK_MEMORY, WALK_RESERVED };
+
+static const uint8_t* fdt_base = NULL;
+
+/* The blob is big-endian */
+static inline uint32_t be32(const void* p) {
+    const uint8_t* b = p;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+           ((uint32_t)b[2] << 8) | b[3];
+}
+
+static inline uint64_t read_cells(const uint8_t* p, uint32_t cells) {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < cells; i++) {
+        v = (v << 32) | be32(p + i * 4);
+    }
+    return v;
+}
+
+static inline uint32_t align4(uint32_t x) {
+    return (x + 3) & ~3U;
+}
+
+int fdt_init(const void* dtb) {
+    const fdt_header_t* h = dtb;
+
+    fdt_base = NULL;
+    if (!dtb || ((uintptr_t)dtb & 3) || be32(&h->magic) != FDT_MAGIC) {
+        return -1;
+    }
+    /* Versions 16 and 17 share the layout read here */
+    if (be32(&h->last_comp_version) > 17) {
+        return -1;
+    }
+    fdt_base = dtb;
+    return 0;
+}
+
+uint32_t fdt_total_size(void) {
+    return fdt_base ? be32(&((const fdt_header_t*)fdt_base)->totalsize) : 0;
+}
+
+/*
+ * Walk the structure block once, tracking #address-cells/#size-cells per
+ * level (a reg property is decoded with its parent's values), and report
+ * the reg ranges of the nodes selected by mode.
+ */
+static int fdt_walk(int mode, fdt_region_fn fn, void* arg) {
+    if (!fdt_base) {
+        return -1;
+    }
+
+    const fdt_header_t* h = (const fdt_header_t*)fdt_base;
+    const uint8_t* p = fdt_base + be32(&h->off_dt_struct);
+    const uint8_t* end = p + be32(&h->size_dt_struct);
+    const char* strings = (const char*)fdt_base + be32(&h->off_dt_strings);
+
+    uint32_t addr_cells[FDT_MAX_DEPTH];
+    uint32_t size_cells[FDT_MAX_DEPTH];
+    int selected[FDT_MAX_DEPTH];
+    int resv_parent[FDT_MAX_DEPTH];
+    int depth = -1;
+
+    while (p < end) {
+        uint32_t token = be32(p);
+        p += 4;
+
+        if (token == FDT_BEGIN_NODE) {
+            const char* name = (const char*)p;
+            p += align4(strlen(name) + 1);
+            if (++depth >= FDT_MAX_DEPTH) {
+                return -1;
+            }
+
+            /* Defaults from the devicetree specification */
+            addr_cells[depth] = 2;
+            size_cells[depth] = 1;
+
+            int is_resv = depth == 1 && strcmp(name, "reserved-memory") == 0;
+            resv_parent[depth] = is_resv;
+            if (mode == WALK_MEMORY) {
+                selected[depth] = depth == 1 && strncmp(name, "memory", 6) == 0 &&
+                                  (name[6] == '\0' || name[6] == '@');
+            } else {
+                selected[depth] = depth == 2 && resv_parent[1];
+            }
+        } else if (token == FDT_END_NODE) {
+            if (--depth < -1) {
+                return -1;
+            }
+        } else if (token == FDT_PROP) {
+            uint32_t len = be32(p);
+            const char* pname = strings + be32(p + 4);
+            const uint8_t* val = p + 8;
+            p += 8 + align4(len);
+
+            if (depth < 0) {
+                continue;
+            }
+            if (strcmp(pname, "#address-cells") == 0 && len == 4) {
+                addr_cells[depth] = be32(val);
+            } else if (strcmp(pname, "#size-cells") == 0 && len == 4) {
+                size_cells[depth] = be32(val);
+            } else if (strcmp(pname, "reg") == 0 && depth > 0 && selected[depth]) {
+                uint32_t ac = addr_cells[depth - 1];
+                uint32_t sc = size_cells[depth - 1];
+                uint32_t entry = (ac + sc) * 4;
+                if (ac > 2 || sc > 2 || entry == 0) {
+                    continue;
+                }
+                for (uint32_t off = 0; off + entry <= len; off += entry) {
+                    uint64_t base = read_cells(val + off, ac);
+                    uint64_t size = read_cells(val + off + ac * 4, sc);
+                    if (size) {
+                        fn(base, size, arg);
+                    }
+                }
+            }
+        } else if (token == FDT_END) {
+            return 0;
+        } else if (token != FDT_NOP) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int fdt_memory(fdt_region_fn fn, void* arg) {
+    return fdt_walk(WALK_MEMORY, fn, arg);
+}
+
+int fdt_reserved(fdt_region_fn fn, void* arg) {
+    if (!fdt_base) {
+        return -1;
+    }
+
+    /* Memory reservation block: (address, size) pairs up to a zero size */
+    const fdt_header_t* h = (const fdt_header_t*)fdt_base;
+    const uint8_t* r = fdt_base + be32(&h->off_mem_rsvmap);
+    for (;; r += 16) {
+        uint64_t base = read_cells(r, 2);
+        uint64_t size = read_cells(r + 8, 2);
+        if (!size) {
+            break;
+        }
+        fn(base, size, arg);
+    }
+
+    return fdt_walk(WALK_RESERVED, fn, arg);
+}
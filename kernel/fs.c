@@ -1,17 +1,38 @@
 #include "fs.h"
 #include "memory.h"
 #include "string.h"
+#include "trace.h"
 #include "types.h"
 #include "kernel.h"
 // #include "drivers/virtio.h"  // Not needed; disk is treated as memory-mapped
 
 /* Superblock lives at the start of a memory-mapped region */
+_Static_assert(sizeof(file_entry_t) == 32, "file records must stay 32 bytes");
+
 static fs_superblock_t* superblock = NULL;
 static void* fs_base = NULL;
 
+/* FNV-1a hash over the name; also reports its length */
+static uint32_t fs_name_hash(const char* name, uint32_t* len_out) {
+    uint32_t hash = 2166136261u;
+    uint32_t len = 0;
+
+    while (name[len]) {
+        hash ^= (uint8_t)name[len];
+        hash *= 16777619u;
+        len++;
+    }
+
+    *len_out = len;
+    return hash;
+}
+
 int fs_init(void) {
-    /* Memory-mapped disk area (see README / linker layout) */
-    fs_base = (void*)0xA0000000;
+    /* In-memory disk area, carved from RAM found at boot */
+    fs_base = memory_alloc_region((size_t)FS_BLOCKS * BLOCK_SIZE);
+    if (!fs_base) {
+        return -1;
+    }
     superblock = (fs_superblock_t*)fs_base;
 
     /* Check if filesystem exists (magic number) */
@@ -20,6 +41,8 @@ int fs_init(void) {
         memset(superblock, 0, sizeof(fs_superblock_t));
         superblock->magic = FS_MAGIC;
         superblock->num_files = 0;
+        superblock->name_heap_used = 0;
+        superblock->next_gen = 1;
         memset(superblock->block_bitmap, 0, sizeof(superblock->block_bitmap));
 
         /* Mark the blocks used by the superblock itself */
@@ -71,6 +94,15 @@ int fs_create_file(const char* name, uint32_t size) {
         return -1;
     }
 
+    uint32_t name_len;
+    uint32_t hash = fs_name_hash(name, &name_len);
+    if (name_len == 0 || name_len >= MAX_FILENAME) {
+        return -1;
+    }
+    if (superblock->name_heap_used + name_len + 1 > FS_NAME_HEAP_SIZE) {
+        return -1;
+    }
+
     /* Don't allow duplicate names */
     if (fs_find_file(name)) {
         return -1;
@@ -82,9 +114,17 @@ int fs_create_file(const char* name, uint32_t size) {
         return -1;
     }
 
+    /* Append the name (with terminator) to the name heap */
+    char* heap_name = superblock->name_heap + superblock->name_heap_used;
+    memcpy(heap_name, name, name_len + 1);
+
     file_entry_t* entry = &superblock->files[superblock->num_files++];
-    strncpy(entry->name, name, MAX_FILENAME - 1);
-    entry->name[MAX_FILENAME - 1] = '\0';  /* ensure null-termination */
+    memset(entry, 0, sizeof(*entry));
+    entry->name_hash   = hash;
+    entry->name_off    = superblock->name_heap_used;
+    entry->name_len    = (uint16_t)name_len;
+    entry->gen         = superblock->next_gen++;
+    superblock->name_heap_used += name_len + 1;
 
     entry->size        = size;
     entry->start_block = (uint32_t)start_block;
@@ -94,23 +134,52 @@ int fs_create_file(const char* name, uint32_t size) {
     return 0;
 }
 
+const char* fs_entry_name(const file_entry_t* entry) {
+    return superblock->name_heap + entry->name_off;
+}
+
+/* Inode number: the record's index in the file table */
+uint32_t fs_entry_ino(const file_entry_t* entry) {
+    return (uint32_t)(entry - superblock->files);
+}
+
 file_entry_t* fs_find_file(const char* name) {
     if (!superblock) return NULL;
 
-    for (int i = 0; i < superblock->num_files; i++) {
-        if (strcmp(superblock->files[i].name, name) == 0) {
-            return &superblock->files[i];
+    uint32_t name_len;
+    uint32_t hash = fs_name_hash(name, &name_len);
+
+    /* Only records whose hash and length match touch the name heap */
+    for (uint32_t i = 0; i < superblock->num_files; i++) {
+        file_entry_t* entry = &superblock->files[i];
+        if (entry->name_hash == hash && entry->name_len == name_len &&
+            strcmp(fs_entry_name(entry), name) == 0) {
+            return entry;
         }
     }
     return NULL;
 }
 
+/* Mapped contents of a file; callers bound reads by entry->size */
+const void* fs_entry_data(const file_entry_t* entry) {
+    return (const uint8_t*)fs_base + entry->start_block * BLOCK_SIZE;
+}
+
 int fs_read_file(const char* name, void* buf, uint32_t size, uint32_t offset) {
+    TRACE(TRACE_FS_READ_BEGIN, size, offset);
+
+    int ret = -1;
     file_entry_t* entry = fs_find_file(name);
-    if (!entry) {
-        return -1;
+    if (entry) {
+        ret = fs_read_entry(entry, buf, size, offset);
     }
 
+    TRACE(TRACE_FS_READ_END, ret, 0);
+    return ret;
+}
+
+/* Read from an already looked-up file, skipping the name search */
+int fs_read_entry(const file_entry_t* entry, void* buf, uint32_t size, uint32_t offset) {
     if (offset >= entry->size) {
         return 0;
     }
@@ -130,7 +199,7 @@ int fs_read_file(const char* name, void* buf, uint32_t size, uint32_t offset) {
     return (int)to_read;
 }
 
-int fs_write_file(const char* name, const void* buf, uint32_t size, uint32_t offset) {
+static int fs_write_contents(const char* name, const void* buf, uint32_t size, uint32_t offset) {
     file_entry_t* entry = fs_find_file(name);
     if (!entry) {
         /* Create file if it doesn't exist yet */
@@ -156,6 +225,9 @@ int fs_write_file(const char* name, const void* buf, uint32_t size, uint32_t off
         }
     }
 
+    /* New contents: cached pages of the old version must not be reused */
+    entry->gen = superblock->next_gen++;
+
     /* Compute location to write to */
     uint32_t block_offset = offset % BLOCK_SIZE;
     uint32_t start_block  = entry->start_block + (offset / BLOCK_SIZE);
@@ -166,6 +238,13 @@ int fs_write_file(const char* name, const void* buf, uint32_t size, uint32_t off
     return (int)size;
 }
 
+int fs_write_file(const char* name, const void* buf, uint32_t size, uint32_t offset) {
+    TRACE(TRACE_FS_WRITE_BEGIN, size, offset);
+    int ret = fs_write_contents(name, buf, size, offset);
+    TRACE(TRACE_FS_WRITE_END, ret, 0);
+    return ret;
+}
+
 int fs_list_files(char* buf, size_t buf_size) {
     if (!superblock) {
         return -1;
@@ -173,9 +252,10 @@ int fs_list_files(char* buf, size_t buf_size) {
 
     int pos = 0;
 
-    for (int i = 0; i < superblock->num_files && pos < (int)buf_size - 1; i++) {
-        const char* name = superblock->files[i].name;
-        int len = (int)strlen(name);
+    for (uint32_t i = 0; i < superblock->num_files && pos < (int)buf_size - 1; i++) {
+        const file_entry_t* entry = &superblock->files[i];
+        const char* name = fs_entry_name(entry);
+        int len = entry->name_len;
 
         if (pos + len + 2 >= (int)buf_size) {
             break;
@@ -189,3 +269,44 @@ int fs_list_files(char* buf, size_t buf_size) {
     buf[pos] = '\0';
     return pos;
 }
+
+/*
+ * Fill buf with as many packed fs_dirent_t entries as fit, starting at
+ * *cursor (0 for the first call). The cursor is advanced past the
+ * entries returned, so each call resumes where the last one stopped.
+ * Returns the number of bytes written, 0 at the end of the directory,
+ * or -1 if buf cannot hold even the next entry.
+ */
+int fs_readdir(uint32_t* cursor, void* buf, size_t buf_size) {
+    if (!superblock || !cursor) {
+        return -1;
+    }
+
+    uint8_t* out = (uint8_t*)buf;
+    size_t pos = 0;
+    uint32_t i = *cursor;
+
+    for (; i < superblock->num_files; i++) {
+        const file_entry_t* entry = &superblock->files[i];
+        size_t reclen = FS_DIRENT_RECLEN(entry->name_len);
+
+        if (pos + reclen > buf_size) {
+            break;
+        }
+
+        fs_dirent_t* d = (fs_dirent_t*)(out + pos);
+        d->size     = entry->size;
+        d->reclen   = (uint16_t)reclen;
+        d->type     = entry->type;
+        d->name_len = (uint8_t)entry->name_len;
+        memcpy(d->name, fs_entry_name(entry), entry->name_len + 1);
+        pos += reclen;
+    }
+
+    if (pos == 0 && i < superblock->num_files) {
+        return -1;
+    }
+
+    *cursor = i;
+    return (int)pos;
+}
@@ -0,0 +1,156 @@
+#include "imgcache.h"
+#include "memory.h"
+#include "sync.h"
+#include "string.h"
+#include "types.h"
+
+#define IMGCACHE_ENTRIES 256
+#define IMGCACHE_BUCKETS 64
+
+typedef struct imgcache_entry {
+    imgcache_key_t key;
+    void* page;
+    int refs;
+    struct imgcache_entry* next;
+} imgcache_entry_t;
+
+static imgcache_entry_t entries[IMGCACHE_ENTRIES];
+static imgcache_entry_t* buckets[IMGCACHE_BUCKETS];
+static imgcache_entry_t* free_entries = NULL;
+static spinlock_t imgcache_lock;
+
+static uint64_t cache_hits = 0;
+static uint64_t cache_misses = 0;
+static int cached_pages = 0;
+
+void imgcache_init(void) {
+    memset(entries, 0, sizeof(entries));
+    memset(buckets, 0, sizeof(buckets));
+    spinlock_init(&imgcache_lock);
+
+    free_entries = NULL;
+    for (int i = IMGCACHE_ENTRIES - 1; i >= 0; i--) {
+        entries[i].next = free_entries;
+        free_entries = &entries[i];
+    }
+}
+
+static inline uint32_t imgcache_hash(const imgcache_key_t* key) {
+    uint32_t h = key->ino * 2654435761u;
+    h ^= key->gen * 40503u;
+    h ^= key->offset >> 12;
+    return h % IMGCACHE_BUCKETS;
+}
+
+static inline int key_equal(const imgcache_key_t* a, const imgcache_key_t* b) {
+    return a->ino == b->ino && a->gen == b->gen && a->offset == b->offset;
+}
+
+/* Caller holds imgcache_lock */
+static imgcache_entry_t* imgcache_find(const imgcache_key_t* key, imgcache_entry_t*** link_out) {
+    imgcache_entry_t** link = &buckets[imgcache_hash(key)];
+
+    while (*link) {
+        if (key_equal(&(*link)->key, key)) {
+            if (link_out) {
+                *link_out = link;
+            }
+            return *link;
+        }
+        link = &(*link)->next;
+    }
+    return NULL;
+}
+
+void* imgcache_lookup(const imgcache_key_t* key) {
+    spinlock_lock(&imgcache_lock);
+
+    imgcache_entry_t* e = imgcache_find(key, NULL);
+    void* page = NULL;
+    if (e) {
+        e->refs++;
+        page = e->page;
+        cache_hits++;
+    } else {
+        cache_misses++;
+    }
+
+    spinlock_unlock(&imgcache_lock);
+    return page;
+}
+
+int imgcache_get(const imgcache_key_t* key, void* page) {
+    spinlock_lock(&imgcache_lock);
+
+    imgcache_entry_t* e = imgcache_find(key, NULL);
+    int ret = -1;
+    if (e && e->page == page) {
+        e->refs++;
+        ret = 0;
+    }
+
+    spinlock_unlock(&imgcache_lock);
+    return ret;
+}
+
+void* imgcache_insert(const imgcache_key_t* key, void* page) {
+    spinlock_lock(&imgcache_lock);
+
+    /* Someone else may have loaded the same page meanwhile */
+    imgcache_entry_t* e = imgcache_find(key, NULL);
+    if (e) {
+        e->refs++;
+        page = e->page;
+    } else if (free_entries) {
+        e = free_entries;
+        free_entries = e->next;
+
+        uint32_t b = imgcache_hash(key);
+        e->key = *key;
+        e->page = page;
+        e->refs = 1;
+        e->next = buckets[b];
+        buckets[b] = e;
+        cached_pages++;
+    } else {
+        page = NULL;
+    }
+
+    spinlock_unlock(&imgcache_lock);
+    return page;
+}
+
+int imgcache_put(const imgcache_key_t* key, void* page) {
+    imgcache_entry_t** link;
+    void* to_free = NULL;
+
+    spinlock_lock(&imgcache_lock);
+
+    imgcache_entry_t* e = imgcache_find(key, &link);
+    if (!e || e->page != page) {
+        spinlock_unlock(&imgcache_lock);
+        return -1;
+    }
+
+    if (--e->refs == 0) {
+        /* Last mapping gone: unlink the entry and release the page */
+        *link = e->next;
+        e->next = free_entries;
+        free_entries = e;
+        to_free = e->page;
+        cached_pages--;
+    }
+
+    spinlock_unlock(&imgcache_lock);
+
+    if (to_free) {
+        free_page(to_free);
+    }
+    return 0;
+}
+
+void imgcache_stats(uint64_t* hits, uint64_t* misses, int* pages) {
+    *hits = cache_hits;
+    *misses = cache_misses;
+    *pages = cached_pages;
+}
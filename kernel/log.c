@@ -0,0 +1,155 @@
+#include "log.h"
+#include "kernel.h"
+#include "task.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "timer.h"
+#include "uart.h"
+#include "printf.h"
+#include "string.h"
+#include "types.h"
+
+_Static_assert(sizeof(log_record_t) == 128, "log records are two cache lines");
+
+static log_record_t log_ring[LOG_SLOTS];
+
+/* Next sequence number to hand out; sequence numbers start at 1 */
+static uint64_t log_next_seq = 1;
+
+/* Next record the console has not shown yet */
+static uint64_t log_drained_seq = 1;
+
+static char hart_buffers[MAX_HARTS][LOG_LINE_MAX];
+
+static spinlock_t drain_lock;
+static wait_queue_t drain_wait;
+static task_t* klogd = NULL;
+
+char* log_hart_buffer(size_t* size) {
+    *size = LOG_LINE_MAX;
+    return hart_buffers[current_hart()];
+}
+
+void log_write(const char* text, size_t len) {
+    uint64_t ticks = timer_get_ticks();
+
+    do {
+        size_t n = len < LOG_TEXT ? len : LOG_TEXT;
+        uint64_t seq = __atomic_fetch_add(&log_next_seq, 1, __ATOMIC_RELAXED);
+        log_record_t* r = &log_ring[seq % LOG_SLOTS];
+
+        __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        r->ticks = ticks;
+        r->len = (uint16_t)n;
+        r->hart = (uint16_t)current_hart();
+        memcpy(r->text, text, n);
+        __atomic_store_n(&r->seq, seq, __ATOMIC_RELEASE);
+
+        text += n;
+        len -= n;
+    } while (len > 0);
+
+    /* klogd only runs when nothing else is ready; don't let busy tasks
+     * push its backlog out of the ring */
+    if (!klogd || log_next_seq - log_drained_seq >= LOG_SLOTS / 2) {
+        log_flush();
+    } else if (drain_wait.head) {
+        wait_queue_wake_all(&drain_wait);
+    }
+}
+
+/*
+ * Copy record seq out of the ring. Returns 1 on success, 0 if it is not
+ * committed yet, -1 if a writer has already reused the slot.
+ */
+static int log_read(uint64_t seq, log_record_t* out) {
+    log_record_t* r = &log_ring[seq % LOG_SLOTS];
+    uint64_t cur = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+    if (cur != seq) {
+        return (cur > seq || seq + LOG_SLOTS <= __atomic_load_n(&log_next_seq, __ATOMIC_ACQUIRE)) ? -1 : 0;
+    }
+    memcpy(out, r, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq ? 1 : -1;
+}
+
+static void log_put_text(const log_record_t* rec) {
+    uart_write(rec->text, rec->len);
+}
+
+void log_flush(void) {
+    log_record_t rec;
+
+    spinlock_lock(&drain_lock);
+    uint64_t next = __atomic_load_n(&log_next_seq, __ATOMIC_ACQUIRE);
+
+    while (log_drained_seq < next) {
+        int got = log_read(log_drained_seq, &rec);
+        if (got == 0) {
+            break;  /* Still being written */
+        }
+        if (got < 0) {
+            /* Overwritten before the console caught up: skip to the oldest */
+            uint64_t oldest = next > LOG_SLOTS ? next - LOG_SLOTS + 1 : 1;
+            char msg[48];
+            snprintf(msg, sizeof(msg), "[log: %lu records dropped]\r\n",
+                     oldest - log_drained_seq);
+            uart_puts(msg);
+            log_drained_seq = oldest > log_drained_seq ? oldest : log_drained_seq + 1;
+            continue;
+        }
+        log_put_text(&rec);
+        log_drained_seq++;
+    }
+    spinlock_unlock(&drain_lock);
+}
+
+/* Background drain task: runs whenever nothing else is ready */
+static void klogd_main(void) {
+    while (1) {
+        log_flush();
+        if (log_drained_seq == __atomic_load_n(&log_next_seq, __ATOMIC_ACQUIRE)) {
+            wait_queue_sleep(&drain_wait);
+        } else {
+            task_yield();
+        }
+    }
+}
+
+void log_start_drain(void) {
+    task_t* task = task_create("klogd", klogd_main);
+    if (!task) {
+        return;  /* Writers keep flushing themselves */
+    }
+    task->background = 1;
+    scheduler_add_task(task);
+    klogd = task;
+}
+
+void log_dump(void) {
+    log_record_t rec;
+    char stamp[48];
+    int line_start = 1;
+
+    /* Show everything pending first so the dump is not interleaved */
+    log_flush();
+
+    uint64_t next = __atomic_load_n(&log_next_seq, __ATOMIC_ACQUIRE);
+    uint64_t seq = next > LOG_SLOTS ? next - LOG_SLOTS : 1;
+
+    for (; seq < next; seq++) {
+        if (log_read(seq, &rec) != 1) {
+            continue;
+        }
+        /* A printf without a newline continues the current line */
+        if (line_start) {
+            uint64_t us = timer_ticks_to_us(rec.ticks);
+            snprintf(stamp, sizeof(stamp), "[%lu.%06lu] ", us / 1000000, us % 1000000);
+            uart_puts(stamp);
+        }
+        log_put_text(&rec);
+        line_start = rec.len > 0 && rec.text[rec.len - 1] == '\n';
+    }
+}
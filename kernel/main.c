@@ -6,30 +6,81 @@
 #include "fs.h"
 #include "shell.h"
 #include "timer.h"
+#include "imgcache.h"
+#include "paging.h"
+#include "trap.h"
+#include "plic.h"
+#include "log.h"
+#include "trace.h"
+#include "perf.h"
+#include "printf.h"
+#include "kernel.h"
 
-extern char _bss_start[];
-extern char _bss_end[];
+uint32_t boot_hartid;
 
-void kernel_main(void) {
-    // Zero BSS section
-    for (char *p = _bss_start; p < _bss_end; p++) {
-        *p = 0;
+/*
+ * Boot-phase timestamps from the time CSR, which counts from reset, so
+ * the first line also covers firmware and entry.S.
+ */
+static uint64_t boot_mark;
+
+static void boot_step_done(const char* step) {
+    uint64_t now = timer_get_ticks();
+    printf("[boot] %s: %lu us\r\n", step, timer_ticks_to_us(now - boot_mark));
+    boot_mark = now;
+}
+
+/* a0/a1 from the firmware survive entry.S: hart id and device tree */
+void kernel_main(uint64_t hartid, const void* dtb) {
+
+    // entry.S has already cleared BSS
+    if (hartid >= MAX_HARTS) {
+        panic("boot hart id beyond MAX_HARTS");
     }
+    boot_hartid = (uint32_t)hartid;
+    boot_mark = 0;
+    boot_step_done("firmware + entry");
+    uint64_t kernel_start = boot_mark;
 
     uart_puts("\r\n=== RISC-V OS Boot ===\r\n");
 
     uart_puts("Initializing memory...\r\n");
-    memory_init();
+    memory_init(dtb);
+    trace_hart_init(hartid);
+    imgcache_init();
+    boot_step_done("memory");
+
+    uart_puts("Initializing paging...\r\n");
+    paging_init();
+    boot_step_done("paging");
+
+    uart_puts("Initializing traps...\r\n");
+    trap_init();
+    boot_step_done("traps");
+
+    uart_puts("Initializing interrupts...\r\n");
+    plic_init();
+    plic_hart_init(hartid);
+    uart_init();
+    boot_step_done("interrupts");
 
     uart_puts("Initializing timer...\r\n");
     timer_init();
+    boot_step_done("timer");
 
     uart_puts("Initializing file system...\r\n");
     fs_init();
+    boot_step_done("file system");
 
     uart_puts("Initializing task system...\r\n");
     scheduler_init();
     task_init();
+    perf_init();
+    log_start_drain();
+    boot_step_done("tasks");
+
+    printf("[boot] kernel_main to shell: %lu us\r\n",
+           timer_ticks_to_us(timer_get_ticks() - kernel_start));
 
     uart_puts("Starting shell...\r\n\r\n");
 
@@ -2,11 +2,27 @@
 #include "kernel.h"
 #include "sync.h"
 #include "string.h"
+#include "fdt.h"
+#include "printf.h"
+#include "trace.h"
 #include "types.h"
 
-#define MEMORY_START 0x80400000
-#define MEMORY_END   0x88000000
-#define HEAP_SIZE    (MEMORY_END - MEMORY_START)
+/*
+ * RAM comes from the device tree's /memory node minus the reserved
+ * regions, the firmware and the kernel image. Without a usable blob
+ * the kernel assumes the smallest layout it is run with (128MB).
+ */
+#define FALLBACK_RAM_BASE 0x80000000UL
+#define FALLBACK_RAM_SIZE 0x08000000UL
+
+/* The heap gets an eighth of RAM within these bounds, the pool the rest */
+#define HEAP_MIN (1UL << 20)
+#define HEAP_MAX (124UL << 20)
+
+/* Left out of the page pool for memory_alloc_region (e.g. the FS image) */
+#define REGION_RESERVE (4UL << 20)
+
+#define MAX_RANGES 16
 
 typedef struct block {
     struct block* next;
@@ -14,8 +30,22 @@ typedef struct block {
     int free;
 } block_t;
 
-/* The actual heap */
-static char heap[HEAP_SIZE];
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} mem_range_t;
+
+/* Usable RAM not yet handed to the heap, the pool or a region */
+static mem_range_t free_ranges[MAX_RANGES];
+static int num_ranges = 0;
+static uint64_t ram_end = 0;
+
+/*
+ * The heap used to be a static array in .bss, which boot had to clear.
+ * Now kmalloc zeroes each block as it hands it out, so callers still
+ * get zeroed memory and heap pages nobody allocates are never touched.
+ */
+extern char _kernel_end[];
 static block_t* free_list = NULL;
 
 static spinlock_t heap_lock;
@@ -23,22 +53,166 @@ static spinlock_t heap_lock;
 /* Track allocated bytes */
 static size_t allocated_bytes = 0;
 
-/* Page pool (simple bump allocator) */
-static void* page_pool = NULL;
+/* Page pool (bump allocator plus a list of freed pages) */
+static uint64_t page_pool_start = 0;
+static uint64_t page_pool_end = 0;
 static size_t page_pool_used = 0;
+static void* page_free_list = NULL;
+
+/* Mappings per pool page; a page is freed when its count drops to 0.
+ * Sized at boot and carved from the front of the pool range. */
+static uint16_t* page_refs = NULL;
+
+static inline int page_index(void* page) {
+    uintptr_t addr = (uintptr_t)page;
+
+    if (addr < page_pool_start || addr >= page_pool_end || (addr & (PAGE_SIZE - 1))) {
+        return -1;
+    }
+    return (int)((addr - page_pool_start) / PAGE_SIZE);
+}
+
+static inline uint64_t page_up(uint64_t x) {
+    return (x + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+}
+
+static inline uint64_t page_down(uint64_t x) {
+    return x & ~(uint64_t)(PAGE_SIZE - 1);
+}
+
+static void range_add(uint64_t base, uint64_t size, void* arg) {
+    (void)arg;
+    uint64_t start = page_up(base);
+    uint64_t end = page_down(base + size);
+
+    if (start < end && num_ranges < MAX_RANGES) {
+        free_ranges[num_ranges].start = start;
+        free_ranges[num_ranges].end = end;
+        num_ranges++;
+        if (end > ram_end) {
+            ram_end = end;
+        }
+    }
+}
+
+/* Cut [base, base + size) out of every free range, splitting if needed */
+static void range_reserve(uint64_t base, uint64_t size, void* arg) {
+    (void)arg;
+    uint64_t start = page_down(base);
+    uint64_t end = page_up(base + size);
 
-void memory_init(void) {
-    /* Set up heap free list */
-    free_list = (block_t*)heap;
-    free_list->size = HEAP_SIZE - sizeof(block_t);
-    free_list->next = NULL;
-    free_list->free = 1;
+    for (int i = 0; i < num_ranges; i++) {
+        mem_range_t* r = &free_ranges[i];
+        if (end <= r->start || start >= r->end) {
+            continue;
+        }
 
+        if (start > r->start && end < r->end) {
+            /* Hole in the middle: keep the tail as a new range */
+            if (num_ranges < MAX_RANGES) {
+                free_ranges[num_ranges].start = end;
+                free_ranges[num_ranges].end = r->end;
+                num_ranges++;
+            }
+            r->end = start;
+        } else if (start > r->start) {
+            r->end = start;
+        } else if (end < r->end) {
+            r->start = end;
+        } else {
+            r->start = r->end;  /* Fully covered */
+        }
+    }
+}
+
+static mem_range_t* range_largest(void) {
+    mem_range_t* best = NULL;
+    for (int i = 0; i < num_ranges; i++) {
+        if (!best || free_ranges[i].end - free_ranges[i].start > best->end - best->start) {
+            best = &free_ranges[i];
+        }
+    }
+    return best;
+}
+
+/* First fit from the low end of RAM; returns 0 if nothing fits */
+static uint64_t range_take(uint64_t size) {
+    size = page_up(size);
+    for (int i = 0; i < num_ranges; i++) {
+        mem_range_t* r = &free_ranges[i];
+        if (r->end - r->start >= size) {
+            uint64_t base = r->start;
+            r->start += size;
+            return base;
+        }
+    }
+    return 0;
+}
+
+void memory_init(const void* dtb) {
     spinlock_init(&heap_lock);
 
-    /* Initialize page pool */
-    page_pool = (void*)0x90000000;         // Start of page pool
+    if (fdt_init(dtb) != 0 || fdt_memory(range_add, NULL) != 0 || num_ranges == 0) {
+        num_ranges = 0;
+        range_add(FALLBACK_RAM_BASE, FALLBACK_RAM_SIZE, NULL);
+        printf("[mem] no device tree, assuming %lu MB\r\n", FALLBACK_RAM_SIZE >> 20);
+    } else {
+        fdt_reserved(range_reserve, NULL);
+        range_reserve((uint64_t)dtb, fdt_total_size(), NULL);
+    }
+
+    /* Firmware sits below the kernel; none of that is ours */
+    range_reserve(0, (uint64_t)_kernel_end, NULL);
+
+    uint64_t total = 0;
+    for (int i = 0; i < num_ranges; i++) {
+        total += free_ranges[i].end - free_ranges[i].start;
+    }
+
+    /* Set up heap free list: one block spanning the whole range */
+    uint64_t heap_size = total / 8;
+    heap_size = heap_size < HEAP_MIN ? HEAP_MIN : heap_size > HEAP_MAX ? HEAP_MAX : heap_size;
+    uint64_t heap_start = range_take(heap_size);
+    if (heap_start) {
+        free_list = (block_t*)heap_start;
+        free_list->size = page_up(heap_size) - sizeof(block_t);
+        free_list->next = NULL;
+        free_list->free = 1;
+    }
+
+    /* Page pool: the largest range left, minus a margin for regions */
+    mem_range_t* r = range_largest();
+    uint64_t pool_end = r ? r->end : 0;
+    if (r && pool_end - r->start > 2 * REGION_RESERVE) {
+        pool_end -= REGION_RESERVE;
+    }
+    if (r && pool_end > r->start) {
+        uint64_t pages = (pool_end - r->start) / PAGE_SIZE;
+        uint64_t refs_size = page_up(pages * sizeof(uint16_t));
+
+        page_refs = (uint16_t*)r->start;
+        memset(page_refs, 0, refs_size);
+        page_pool_start = r->start + refs_size;
+        page_pool_end = pool_end;
+        r->start = pool_end;
+    }
     page_pool_used = 0;
+    page_free_list = NULL;
+
+    printf("[mem] RAM up to %lx: heap %lu KB, page pool %lu pages\r\n",
+           ram_end, heap_size >> 10, (page_pool_end - page_pool_start) / PAGE_SIZE);
+}
+
+/* Physical range for a fixed-size user (e.g. the FS image); not zeroed */
+void* memory_alloc_region(size_t size) {
+    spinlock_lock(&heap_lock);
+    uint64_t base = range_take(size);
+    spinlock_unlock(&heap_lock);
+    return (void*)base;
+}
+
+uint64_t memory_ram_end(void) {
+    return ram_end;
 }
 
 /* Align to 8 bytes */
@@ -73,7 +247,11 @@ void* kmalloc(size_t size) {
             allocated_bytes += cur->size;
 
             spinlock_unlock(&heap_lock);
-            return (char*)cur + sizeof(block_t);
+
+            void* ptr = (char*)cur + sizeof(block_t);
+            memset(ptr, 0, size);
+            TRACE(TRACE_KMALLOC, size, ptr);
+            return ptr;
         }
 
         cur = cur->next;
@@ -86,6 +264,8 @@ void* kmalloc(size_t size) {
 void kfree(void* ptr) {
     if (!ptr) return;
 
+    TRACE(TRACE_KFREE, ptr, 0);
+
     block_t* b = (block_t*)((char*)ptr - sizeof(block_t));
 
     spinlock_lock(&heap_lock);
@@ -112,29 +292,64 @@ void kfree(void* ptr) {
     spinlock_unlock(&heap_lock);
 }
 
-/* Simple bump allocator for 4KB pages */
+/* Allocate a zeroed 4KB page, reusing freed pages before bumping */
 void* get_free_page(void) {
     spinlock_lock(&heap_lock);
 
-    uintptr_t addr = (uintptr_t)page_pool + page_pool_used * PAGE_SIZE;
+    void* page = page_free_list;
+    if (page) {
+        page_free_list = *(void**)page;
+    } else {
+        uintptr_t addr = page_pool_start + page_pool_used * PAGE_SIZE;
 
-    if (addr + PAGE_SIZE >= 0x98000000) {
-        spinlock_unlock(&heap_lock);
-        return NULL; // Out of pages
-    }
+        if (addr + PAGE_SIZE > page_pool_end) {
+            spinlock_unlock(&heap_lock);
+            return NULL; // Out of pages
+        }
 
-    page_pool_used++;
+        page_pool_used++;
+        page = (void*)addr;
+    }
 
-    void* page = (void*)addr;
     memset(page, 0, PAGE_SIZE);
+    page_refs[page_index(page)] = 1;
 
     spinlock_unlock(&heap_lock);
     return page;
 }
 
+/* Drop a reference; the last one puts the page back on the free list */
 void free_page(void* page) {
-    /* Not implemented (simple pool) */
-    (void)page;
+    int idx = page_index(page);
+
+    /* Only pages handed out by the pool go back on the list */
+    if (idx < 0) {
+        return;
+    }
+
+    spinlock_lock(&heap_lock);
+    if (page_refs[idx] > 0 && --page_refs[idx] == 0) {
+        *(void**)page = page_free_list;
+        page_free_list = page;
+    }
+    spinlock_unlock(&heap_lock);
+}
+
+/* Take another reference to a page (e.g. a copy-on-write mapping) */
+void page_ref_get(void* page) {
+    int idx = page_index(page);
+    if (idx < 0) {
+        return;
+    }
+
+    spinlock_lock(&heap_lock);
+    page_refs[idx]++;
+    spinlock_unlock(&heap_lock);
+}
+
+int page_ref_count(void* page) {
+    int idx = page_index(page);
+    return idx < 0 ? 0 : page_refs[idx];
 }
 
 /* For shell "meminfo" */
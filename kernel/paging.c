@@ -1,17 +1,257 @@
 #include "paging.h"
 #include "memory.h"
+#include "string.h"
+#include "sync.h"
 #include "types.h"
 
-/* Simple identity paging for now */
-/* In a full implementation, we'd have proper page tables */
+#define VPN(va, level) (((va) >> (12 + 9 * (level))) & 0x1FF)
 
+#define MEGAPAGE_SIZE (1UL << 21)
+#define GIGAPAGE_SIZE (1UL << 30)
+
+#define USER_SLOT VPN(USER_BASE, 2)
+
+/* QEMU virt devices, mapped with 2MB megapages */
+#define RTC_MMIO  0x00101000UL   /* Goldfish RTC */
+#define PLIC_BASE 0x0C000000UL
+#define PLIC_SIZE 0x00600000UL
+#define UART_MMIO 0x10000000UL   /* UART and VirtIO MMIO share this megapage */
+
+#define RAM_BASE  0x80000000UL
+
+#define KERNEL_RW  (PTE_R | PTE_W | PTE_G | PTE_A | PTE_D)
+#define KERNEL_RWX (KERNEL_RW | PTE_X)
+
+static pte_t* kernel_root = NULL;
+static uint64_t kernel_satp = 0;
+
+/*
+ * ASIDs are handed out in increasing order within a generation; ASID 0
+ * belongs to the kernel table. When they run out the generation is
+ * bumped and the TLB flushed once, and tasks pick up a fresh ASID the
+ * next time they are switched to.
+ */
+static uint64_t asid_max = 0;
+static uint64_t asid_next = 1;
+static uint64_t asid_generation = 1;
+static int asid_enabled = 0;
+static spinlock_t asid_lock;
+
+static void map_megapages(pte_t* l1, uint64_t base, uint64_t size) {
+    for (uint64_t pa = base & ~(MEGAPAGE_SIZE - 1); pa < base + size; pa += MEGAPAGE_SIZE) {
+        l1[VPN(pa, 1)] = PA_TO_PTE(pa) | KERNEL_RW | PTE_V;
+    }
+}
+
+/*
+ * Build the kernel table: a direct map of RAM with gigapages and the
+ * device window with megapages, so the whole kernel costs a handful of
+ * TLB entries. Then turn on Sv39.
+ */
 void paging_init(void) {
-    /* For now, we'll use identity mapping */
-    /* RISC-V uses Sv39 paging, but for simplicity we'll skip it initially */
+    kernel_root = get_free_page();
+    pte_t* mmio_l1 = get_free_page();
+    if (!kernel_root || !mmio_l1) {
+        return;
+    }
+
+    map_megapages(mmio_l1, RTC_MMIO, 1);
+    map_megapages(mmio_l1, PLIC_BASE, PLIC_SIZE);
+    map_megapages(mmio_l1, UART_MMIO, MEGAPAGE_SIZE);
+    kernel_root[0] = PA_TO_PTE(mmio_l1) | PTE_V;
+
+    /* As many gigapages as the RAM found at boot needs */
+    for (uint64_t pa = RAM_BASE; pa < memory_ram_end() && VPN(pa, 2) < 511; pa += GIGAPAGE_SIZE) {
+        kernel_root[VPN(pa, 2)] = PA_TO_PTE(pa) | KERNEL_RWX | PTE_V;
+    }
+
+    kernel_satp = MAKE_SATP(kernel_root);
+
+    /* Probe how many ASID bits the hart implements */
+    uint64_t probe = kernel_satp | SATP_ASID_MASK;
+    asm volatile("csrw satp, %0" :: "r"(probe));
+    asm volatile("csrr %0, satp" : "=r"(probe));
+    asid_max = SATP_ASID(probe);
+    asid_enabled = asid_max > 0;
+    spinlock_init(&asid_lock);
+
+    asm volatile("csrw satp, %0" :: "r"(kernel_satp));
+    asm volatile("sfence.vma zero, zero" ::: "memory");
+}
+
+uint64_t paging_kernel_satp(void) {
+    return kernel_satp;
+}
+
+void* paging_kernel_root(void) {
+    return kernel_root;
 }
 
+/* New task root: kernel slots shared, user window empty */
 void* setup_page_table(void) {
-    /* Allocate a page for page table */
-    return get_free_page();
+    pte_t* root = get_free_page();
+    if (!root) {
+        return NULL;
+    }
+
+    if (kernel_root) {
+        memcpy(root, kernel_root, PAGE_SIZE);
+        root[USER_SLOT] = 0;
+    }
+    return root;
+}
+
+/*
+ * Free the user window's intermediate tables and the root itself.
+ * Leaf pages must already have been released by the VM layer.
+ */
+void paging_free_table(void* root_ptr) {
+    pte_t* root = root_ptr;
+    if (!root || root == kernel_root) {
+        return;
+    }
+
+    pte_t l2 = root[USER_SLOT];
+    if ((l2 & PTE_V) && !(l2 & (PTE_R | PTE_W | PTE_X))) {
+        pte_t* l1 = (pte_t*)PTE_TO_PA(l2);
+        for (int i = 0; i < 512; i++) {
+            if ((l1[i] & PTE_V) && !(l1[i] & (PTE_R | PTE_W | PTE_X))) {
+                free_page((void*)PTE_TO_PA(l1[i]));
+            }
+        }
+        free_page(l1);
+    }
+
+    free_page(root);
+}
+
+/*
+ * Install an address space on this hart. TLB entries are tagged with
+ * the ASID, so nothing needs flushing unless ASIDs are unavailable.
+ */
+void paging_switch(uint64_t satp) {
+    uint64_t cur;
+    asm volatile("csrr %0, satp" : "=r"(cur));
+    if (cur == satp) {
+        return;
+    }
+
+    asm volatile("csrw satp, %0" :: "r"(satp));
+    if (!asid_enabled) {
+        asm volatile("sfence.vma zero, zero" ::: "memory");
+    }
+}
+
+/* Caller holds asid_lock */
+static uint64_t asid_alloc(void) {
+    if (asid_next > asid_max) {
+        asid_generation++;
+        asid_next = 1;
+        /* Every ASID handed out so far is now stale */
+        asm volatile("sfence.vma zero, zero" ::: "memory");
+    }
+    return asid_next++;
+}
+
+/*
+ * Switch to a task's table, first giving it an ASID from the current
+ * generation if its old one has been recycled. The ASID is kept in the
+ * task's satp value.
+ */
+void paging_activate(uint64_t* satp, uint64_t* asid_gen) {
+    if (asid_enabled && SATP_ROOT(*satp) != (uint64_t)kernel_root) {
+        spinlock_lock(&asid_lock);
+        if (*asid_gen != asid_generation) {
+            *satp = (*satp & ~SATP_ASID_MASK) | (asid_alloc() << SATP_ASID_SHIFT);
+            *asid_gen = asid_generation;
+        }
+        spinlock_unlock(&asid_lock);
+    }
+
+    paging_switch(*satp);
+}
+
+/* Toggle ASID use (for benchmarking); returns the previous setting */
+int paging_set_asid_enabled(int enabled) {
+    int old = asid_enabled;
+    asid_enabled = enabled && asid_max > 0;
+    asm volatile("sfence.vma zero, zero" ::: "memory");
+    return old;
+}
+
+/*
+ * Return the level-0 PTE for va, allocating intermediate tables when
+ * alloc is set. Returns NULL if a table is missing (or cannot be
+ * allocated) or a megapage already covers va.
+ */
+pte_t* paging_walk(pte_t* root, uint64_t va, int alloc) {
+    pte_t* table = root;
+
+    for (int level = 2; level > 0; level--) {
+        pte_t* pte = &table[VPN(va, level)];
+
+        if (*pte & PTE_V) {
+            if (*pte & (PTE_R | PTE_W | PTE_X)) {
+                return NULL;  /* Leaf at a higher level */
+            }
+            table = (pte_t*)PTE_TO_PA(*pte);
+        } else {
+            if (!alloc) {
+                return NULL;
+            }
+            table = get_free_page();
+            if (!table) {
+                return NULL;
+            }
+            *pte = PA_TO_PTE(table) | PTE_V;
+        }
+    }
+
+    return &table[VPN(va, 0)];
+}
+
+int paging_map(pte_t* root, uint64_t va, uint64_t pa, uint64_t flags) {
+    if (va < USER_BASE || va >= USER_TOP) {
+        return -1;
+    }
+
+    pte_t* pte = paging_walk(root, va, 1);
+    if (!pte || (*pte & PTE_V)) {
+        return -1;
+    }
+
+    *pte = PA_TO_PTE(pa) | flags | PTE_V;
+    return 0;
 }
 
+/* Remove the mapping for va in the table installed by satp and flush
+ * only that page from the TLB; returns the physical page or 0 */
+uint64_t paging_unmap(pte_t* root, uint64_t va, uint64_t satp) {
+    pte_t* pte = paging_walk(root, va, 0);
+    if (!pte || !(*pte & PTE_V)) {
+        return 0;
+    }
+
+    uint64_t pa = PTE_TO_PA(*pte);
+    *pte = 0;
+    paging_flush_page(va, satp);
+    return pa;
+}
+
+/* Flush one page of the address space identified by satp */
+void paging_flush_page(uint64_t va, uint64_t satp) {
+    if (asid_enabled) {
+        asm volatile("sfence.vma %0, %1" :: "r"(va), "r"(SATP_ASID(satp)) : "memory");
+    } else {
+        asm volatile("sfence.vma %0, zero" :: "r"(va) : "memory");
+    }
+}
+
+/* Flush every non-global entry of the address space identified by satp */
+void paging_flush_asid(uint64_t satp) {
+    if (asid_enabled) {
+        asm volatile("sfence.vma zero, %0" :: "r"(SATP_ASID(satp)) : "memory");
+    } else {
+        asm volatile("sfence.vma zero, zero" ::: "memory");
+    }
+}
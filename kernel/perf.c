@@ -0,0 +1,67 @@
+#include "perf.h"
+#include "task.h"
+#include "sbi.h"
+#include "printf.h"
+#include "types.h"
+
+static inline uint64_t read_cycles(void) {
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+static inline uint64_t read_instret(void) {
+    uint64_t c;
+    asm volatile("rdinstret %0" : "=r"(c));
+    return c;
+}
+
+static int perf_start_event(uint64_t event) {
+    /* Match among the fixed counters: cycle (0) and instret (2) */
+    sbiret_t ret = sbi_ecall(SBI_EXT_PMU, SBI_PMU_COUNTER_CFG_MATCH,
+                             0, 0x5, SBI_PMU_CFG_AUTO_START, event, 0, 0);
+    return ret.error == SBI_SUCCESS ? (int)ret.value : -1;
+}
+
+/* Runs after task_init: the boot task is never switched in, so its
+ * marks start here instead of at 0 (which would charge it since reset) */
+void perf_init(void) {
+    if (!sbi_probe_extension(SBI_EXT_PMU)) {
+        printf("[perf] no SBI PMU, using free-running counters\r\n");
+    } else {
+        int cyc = perf_start_event(SBI_PMU_HW_CPU_CYCLES);
+        int ins = perf_start_event(SBI_PMU_HW_INSTRUCTIONS);
+        printf("[perf] SBI PMU: cycles on counter %d, instructions on counter %d\r\n",
+               cyc, ins);
+    }
+
+    perf_switch(NULL, get_current_task());
+}
+
+void perf_switch(task_t* prev, task_t* next) {
+    uint64_t cycles = read_cycles();
+    uint64_t instret = read_instret();
+
+    if (prev) {
+        prev->perf.total.cycles += cycles - prev->perf.cycle_mark;
+        prev->perf.total.instret += instret - prev->perf.instret_mark;
+    }
+    if (next) {
+        next->perf.cycle_mark = cycles;
+        next->perf.instret_mark = instret;
+    }
+}
+
+void perf_read(task_t* t, perf_counts_t* out) {
+    *out = t->perf.total;
+    if (t == get_current_task()) {
+        out->cycles += read_cycles() - t->perf.cycle_mark;
+        out->instret += read_instret() - t->perf.instret_mark;
+    }
+}
+
+void perf_count_fault(task_t* t) {
+    if (t) {
+        t->perf.total.faults++;
+    }
+}
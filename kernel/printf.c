@@ -1,122 +1,187 @@
+#include "printf.h"
 #include "types.h"
-#include "uart.h"
+#include "log.h"
+
+/*
+ * The formatting engine writes into a caller-supplied buffer, counting
+ * what does not fit. printf formats into the hart's log buffer and
+ * hands the result to the kernel log as one write, so a call costs
+ * formatting plus a copy, never a wait on the UART.
+ */
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+} fmt_out_t;
+
+static void out_char(fmt_out_t* out, char c) {
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
 
-typedef __builtin_va_list va_list;
-#define va_start(ap, last) __builtin_va_start(ap, last)
-#define va_end(ap) __builtin_va_end(ap)
-#define va_arg(ap, type) __builtin_va_arg(ap, type)
+static void out_str(fmt_out_t* out, const char* s) {
+    while (*s) {
+        out_char(out, *s++);
+    }
+}
 
-/* print unsigned 64-bit integer */
-static void print_uint64(uint64_t n, int base) {
+/* print unsigned 64-bit integer, padded to width */
+static void print_uint64(fmt_out_t* out, uint64_t n, int base, int width, char pad) {
     char buf[32];
     int i = 0;
 
-    if (n == 0) {
-        uart_putchar('0');
-        return;
-    }
-
-    while (n > 0) {
+    do {
         int digit = n % base;
         buf[i++] = (digit < 10)
             ? ('0' + digit)
             : ('a' + (digit - 10));
         n /= base;
-    }
+    } while (n > 0);
 
+    while (width-- > i)
+        out_char(out, pad);
     while (i--)
-        uart_putchar(buf[i]);
+        out_char(out, buf[i]);
 }
 
-void printf(const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-
+static void format(fmt_out_t* out, const char* fmt, va_list args) {
     while (*fmt) {
-        if (*fmt == '%') {
+        if (*fmt != '%') {
+            out_char(out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        /* Left alignment, zero padding and field width, e.g. %03lu, %-8s */
+        char pad = ' ';
+        int width = 0;
+        int left = 0;
+        if (*fmt == '-') {
+            left = 1;
+            fmt++;
+        }
+        if (*fmt == '0') {
+            pad = '0';
             fmt++;
+        }
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
 
-            /* ======== %l and %ll support ======== */
-            if (*fmt == 'l') {
-                fmt++;
-                if (*fmt == 'l') {   // %ll
-                    fmt++;
-                    if (*fmt == 'u') {
-                        uint64_t v = va_arg(args, unsigned long long);
-                        print_uint64(v, 10);
-                    } else if (*fmt == 'x') {
-                        uart_puts("0x");
-                        uint64_t v = va_arg(args, unsigned long long);
-                        print_uint64(v, 16);
-                    }
-                } else {             // %l
-                    if (*fmt == 'u') {
-                        unsigned long v = va_arg(args, unsigned long);
-                        print_uint64(v, 10);
-                    }
-                    else if (*fmt == 'x') {
-                        uart_puts("0x");
-                        unsigned long v = va_arg(args, unsigned long);
-                        print_uint64(v, 16);
-                    }
+        /* ======== %l and %ll support ======== */
+        int is_long = 0;
+        while (*fmt == 'l') {
+            is_long = 1;
+            fmt++;
+        }
+
+        /* Right alignment pads as it prints; left alignment pads after */
+        size_t start = out->len;
+        int left_width = left ? width : 0;
+        if (left) {
+            width = 0;
+        }
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t val = is_long ? va_arg(args, long) : va_arg(args, int);
+                if (val < 0) {
+                    out_char(out, '-');
+                    val = -val;
+                    width--;
                 }
+                print_uint64(out, (uint64_t)val, 10, width, pad);
+                break;
             }
-            else {
-
-                /* ======== normal formatting ======== */
-                switch (*fmt) {
-                    case 'd':
-                    case 'i': {
-                        int val = va_arg(args, int);
-                        if (val < 0) {
-                            uart_putchar('-');
-                            val = -val;
-                        }
-                        print_uint64((uint64_t)val, 10);
-                        break;
-                    }
-
-                    case 'u':
-                        print_uint64((uint64_t)va_arg(args, unsigned int), 10);
-                        break;
-
-                    case 'x':
-                        uart_puts("0x");
-                        print_uint64((uint64_t)va_arg(args, unsigned int), 16);
-                        break;
-
-                    case 'p':
-                        uart_puts("0x");
-                        print_uint64((uint64_t)va_arg(args, uintptr_t), 16);
-                        break;
-
-                    case 's': {
-                        const char* s = va_arg(args, const char*);
-                        uart_puts(s);
-                        break;
-                    }
-
-                    case 'c':
-                        uart_putchar(va_arg(args, int));
-                        break;
-
-                    case '%':
-                        uart_putchar('%');
-                        break;
-
-                    default:
-                        uart_putchar('%');
-                        uart_putchar(*fmt);
-                        break;
+
+            case 'u':
+                print_uint64(out, is_long ? va_arg(args, unsigned long)
+                                          : va_arg(args, unsigned int), 10, width, pad);
+                break;
+
+            case 'x':
+                out_str(out, "0x");
+                print_uint64(out, is_long ? va_arg(args, unsigned long)
+                                          : va_arg(args, unsigned int), 16, width, pad);
+                break;
+
+            case 'p':
+                out_str(out, "0x");
+                print_uint64(out, (uint64_t)va_arg(args, uintptr_t), 16, width, pad);
+                break;
+
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                if (!s) {
+                    s = "(null)";
                 }
+                int len = 0;
+                while (s[len]) {
+                    len++;
+                }
+                while (width-- > len) {
+                    out_char(out, ' ');
+                }
+                out_str(out, s);
+                break;
             }
+
+            case 'c':
+                out_char(out, (char)va_arg(args, int));
+                break;
+
+            case '%':
+                out_char(out, '%');
+                break;
+
+            case '\0':
+                out_char(out, '%');
+                return;
+
+            default:
+                out_char(out, '%');
+                out_char(out, *fmt);
+                break;
         }
-        else {
-            uart_putchar(*fmt);
+        while (out->len - start < (size_t)left_width) {
+            out_char(out, ' ');
         }
-
         fmt++;
     }
+}
+
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    fmt_out_t out = { buf, size, 0 };
+
+    format(&out, fmt, args);
+    if (size) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return (int)out.len;
+}
+
+int snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
 
+    va_start(args, fmt);
+    int len = vsnprintf(buf, size, fmt, args);
     va_end(args);
+    return len;
+}
+
+int printf(const char* fmt, ...) {
+    size_t size;
+    char* buf = log_hart_buffer(&size);
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+
+    /* One bulk write; output past the end of the buffer is dropped */
+    log_write(buf, (size_t)len < size ? (size_t)len : size - 1);
+    return len;
 }
@@ -0,0 +1,191 @@
+#include "profile.h"
+#include "kernel.h"
+#include "memory.h"
+#include "timer.h"
+#include "uart.h"
+#include "log.h"
+#include "printf.h"
+#include "string.h"
+#include "types.h"
+
+_Static_assert((PROFILE_SLOTS & (PROFILE_SLOTS - 1)) == 0, "slot count must be a power of two");
+
+/* Give up on a stack after this many occupied slots */
+#define PROFILE_PROBES 16
+
+static profile_slot_t* slots = NULL;
+static int running = 0;
+static uint32_t rate_hz;
+static uint64_t period;             /* time CSR ticks between samples */
+static uint64_t next_tick;
+
+static uint64_t samples;
+static uint64_t dropped;            /* Table full or too many collisions */
+
+int profile_active(void) {
+    return running;
+}
+
+int profile_start(uint32_t hz) {
+    if (hz == 0 || hz > PROFILE_HZ_MAX) {
+        return -1;
+    }
+    if (!slots) {
+        slots = kmalloc(PROFILE_SLOTS * sizeof(profile_slot_t));
+        if (!slots) {
+            return -1;
+        }
+    }
+
+    memset(slots, 0, PROFILE_SLOTS * sizeof(profile_slot_t));
+    samples = 0;
+    dropped = 0;
+    rate_hz = hz;
+    period = timer_get_freq() / hz;
+    next_tick = timer_get_ticks() + period;
+    running = 1;
+
+    /* Device interrupts only inside scheduler windows */
+    asm volatile("csrc sie, %0" :: "r"(SIE_SEIE));
+    timer_set_sample(next_tick);
+    profile_unmask();
+    return 0;
+}
+
+void profile_stop(void) {
+    if (!running) {
+        return;
+    }
+    running = 0;
+
+    asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_SIE));
+    asm volatile("csrs sie, %0" :: "r"(SIE_SEIE));
+    timer_set_sample(~0UL);
+}
+
+/*
+ * Walk saved frame pointers: with -fno-omit-frame-pointer, s0 points
+ * just above the frame, which holds ra at s0-8 and the caller's s0 at
+ * s0-16. Frames must stay on the interrupted kernel stack and move up.
+ */
+static int profile_backtrace(const trapframe_t* tf, uint64_t* pc) {
+    uint64_t lo = tf->regs[2];
+    uint64_t hi = lo + KERNEL_STACK_SIZE;
+    uint64_t fp = tf->regs[8];
+    int depth = 1;
+
+    pc[0] = tf->sepc;
+    while (depth < PROFILE_DEPTH) {
+        if (fp < lo + 16 || fp > hi || (fp & 7)) {
+            break;
+        }
+        uint64_t ra = ((uint64_t*)fp)[-1];
+        uint64_t prev = ((uint64_t*)fp)[-2];
+        if (ra == 0) {
+            break;
+        }
+        pc[depth++] = ra;
+        if (prev <= fp) {
+            break;
+        }
+        lo = fp;
+        fp = prev;
+    }
+    return depth;
+}
+
+static int profile_same_stack(const profile_slot_t* s, const uint64_t* pc,
+                              int depth, int user) {
+    if (s->depth != depth || s->user != user) {
+        return 0;
+    }
+    for (int i = 0; i < depth; i++) {
+        if (s->pc[i] != pc[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void profile_record(const uint64_t* pc, int depth, int user) {
+    uint64_t h = 0;
+    for (int i = 0; i < depth; i++) {
+        h = (h ^ pc[i]) * 0x100000001b3UL;
+    }
+
+    for (int probe = 0; probe < PROFILE_PROBES; probe++) {
+        profile_slot_t* s = &slots[(h + probe) & (PROFILE_SLOTS - 1)];
+        if (s->depth == 0) {
+            memcpy(s->pc, pc, depth * sizeof(uint64_t));
+            s->depth = (uint16_t)depth;
+            s->user = (uint16_t)user;
+            s->count = 1;
+            return;
+        }
+        if (profile_same_stack(s, pc, depth, user)) {
+            s->count++;
+            return;
+        }
+    }
+    dropped++;
+}
+
+void profile_sample(trapframe_t* tf) {
+    /* The comparator also fires for scheduler ticks */
+    uint64_t now = timer_get_ticks();
+    if (!running || now < next_tick) {
+        return;
+    }
+
+    uint64_t pc[PROFILE_DEPTH];
+    int user = !(tf->sstatus & SSTATUS_SPP);
+    int depth = 1;
+
+    if (user) {
+        pc[0] = tf->sepc;
+    } else {
+        depth = profile_backtrace(tf, pc);
+    }
+    samples++;
+    profile_record(pc, depth, user);
+
+    /* Keep the sampling grid; skip ticks that were missed entirely */
+    next_tick += period;
+    if (next_tick <= now) {
+        next_tick = now + period;
+    }
+    timer_set_sample(next_tick);
+}
+
+void profile_dump(void) {
+    char line[32 + PROFILE_DEPTH * 20];
+
+    if (!slots) {
+        printf("profile: no samples\r\n");
+        return;
+    }
+
+    /* Straight to the UART: the table is bigger than the log ring */
+    log_flush();
+
+    int n = snprintf(line, sizeof(line), "--- profile begin ---\r\nhz %u samples %lu dropped %lu\r\n",
+                     rate_hz, samples, dropped);
+    uart_write(line, n);
+
+    for (int i = 0; i < PROFILE_SLOTS; i++) {
+        profile_slot_t* s = &slots[i];
+        if (s->depth == 0) {
+            continue;
+        }
+        n = snprintf(line, sizeof(line), "%u %c", s->count, s->user ? 'u' : 'k');
+        for (int d = 0; d < s->depth; d++) {
+            n += snprintf(line + n, sizeof(line) - n, " %lx", s->pc[d]);
+        }
+        n += snprintf(line + n, sizeof(line) - n, "\r\n");
+        uart_write(line, n);
+    }
+
+    uart_puts("--- profile end ---\r\n");
+    printf("profile: %lu samples, %lu dropped%s\r\n", samples, dropped,
+           running ? " (still running)" : "");
+}
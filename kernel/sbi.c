@@ -0,0 +1,46 @@
+#include "sbi.h"
+#include "types.h"
+
+#define SBI_BASE_PROBE_EXTENSION 3
+#define SBI_TIME_SET_TIMER       0
+
+/* Probed on first use: 1 = TIME extension, 0 = legacy call, -1 = unknown */
+static int have_time_ext = -1;
+
+sbiret_t sbi_ecall(long eid, long fid, uint64_t a0, uint64_t a1,
+                   uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+    register uint64_t r0 asm("a0") = a0;
+    register uint64_t r1 asm("a1") = a1;
+    register uint64_t r2 asm("a2") = a2;
+    register uint64_t r3 asm("a3") = a3;
+    register uint64_t r4 asm("a4") = a4;
+    register uint64_t r5 asm("a5") = a5;
+    register uint64_t r6 asm("a6") = (uint64_t)fid;
+    register uint64_t r7 asm("a7") = (uint64_t)eid;
+
+    asm volatile("ecall"
+                 : "+r"(r0), "+r"(r1)
+                 : "r"(r2), "r"(r3), "r"(r4), "r"(r5), "r"(r6), "r"(r7)
+                 : "memory");
+
+    sbiret_t ret = { (long)r0, (long)r1 };
+    return ret;
+}
+
+int sbi_probe_extension(long eid) {
+    sbiret_t ret = sbi_ecall(SBI_EXT_BASE, SBI_BASE_PROBE_EXTENSION,
+                             (uint64_t)eid, 0, 0, 0, 0, 0);
+    return ret.error == SBI_SUCCESS && ret.value != 0;
+}
+
+void sbi_set_timer(uint64_t when) {
+    if (have_time_ext < 0) {
+        have_time_ext = sbi_probe_extension(SBI_EXT_TIME);
+    }
+
+    if (have_time_ext) {
+        sbi_ecall(SBI_EXT_TIME, SBI_TIME_SET_TIMER, when, 0, 0, 0, 0, 0);
+    } else {
+        sbi_ecall(SBI_EXT_LEGACY_SET_TIMER, 0, when, 0, 0, 0, 0, 0);
+    }
+}
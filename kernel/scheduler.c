@@ -1,72 +1,228 @@
 #include "scheduler.h"
 #include "task.h"
+#include "kernel.h"
 #include "sync.h"
 #include "types.h"
 #include "timer.h"
+#include "paging.h"
+#include "trap.h"
+#include "trace.h"
+#include "profile.h"
+#include "perf.h"
+#include "clock.h"
+#include "string.h"
 
 static task_t* ready_queue = NULL;
 static spinlock_t scheduler_lock;
 
+/* Set by scheduler_preempt for the yield it is about to make */
+static int preempting = 0;
+
+/* Wakeup-to-run latency of every dispatch on each hart */
+static hist_t hart_latency[MAX_HARTS];
+
 void scheduler_init(void) {
     spinlock_init(&scheduler_lock);
 }
 
-/* Add a task to the ready queue (LIFO simple queue) */
-void scheduler_add_task(task_t* task) {
-    if (!task) return;
-
+/*
+ * Queue a task (LIFO simple queue). Background tasks go to the tail, so
+ * they only run when nothing else is ready.
+ */
+static void scheduler_enqueue(task_t* task) {
     spinlock_lock(&scheduler_lock);
 
-    task->next = ready_queue;
-    ready_queue = task;
+    if (task->background) {
+        task_t** link = &ready_queue;
+        while (*link) {
+            link = &(*link)->rq_next;
+        }
+        task->rq_next = NULL;
+        *link = task;
+    } else {
+        task->rq_next = ready_queue;
+        ready_queue = task;
+    }
 
     spinlock_unlock(&scheduler_lock);
 }
 
+/*
+ * Add a new or woken task to the ready queue. Only these are stamped for
+ * latency; scheduler_yield requeues the running task without a stamp,
+ * so yielding to itself records no sample.
+ */
+void scheduler_add_task(task_t* task) {
+    if (!task) return;
+
+    task->ready_ticks = timer_get_ticks();
+    scheduler_enqueue(task);
+}
+
 /* Pop the next task from the ready queue */
 task_t* scheduler_get_next_task(void) {
     spinlock_lock(&scheduler_lock);
 
     task_t* task = ready_queue;
     if (task) {
-        ready_queue = task->next;
-        task->next = NULL;
+        ready_queue = task->rq_next;
+        task->rq_next = NULL;
     }
 
     spinlock_unlock(&scheduler_lock);
     return task;
 }
 
+/* Unlink a task from the ready queue if it is queued */
+void scheduler_remove_task(task_t* task) {
+    spinlock_lock(&scheduler_lock);
+
+    task_t** link = &ready_queue;
+    while (*link) {
+        if (*link == task) {
+            *link = task->rq_next;
+            task->rq_next = NULL;
+            break;
+        }
+        link = &(*link)->rq_next;
+    }
+
+    spinlock_unlock(&scheduler_lock);
+}
+
 /* NEW: expose the ready queue so shell.c can implement ps */
 task_t* scheduler_get_task_list(void) {
     return ready_queue;
 }
 
+/*
+ * The kernel runs with interrupts disabled; these open a window for
+ * them, and device interrupts are only taken inside one. Handlers only
+ * queue data and wake tasks. While the profiler runs, sstatus.SIE stays
+ * set outside the windows for its timer and sie.SEIE is what keeps
+ * device interrupts out.
+ */
+static void interrupt_window_open(void) {
+    if (profile_active()) {
+        asm volatile("csrs sie, %0" :: "r"(SIE_SEIE));
+    }
+    asm volatile("csrs sstatus, %0" :: "r"(SSTATUS_SIE));
+}
+
+static void interrupt_window_close(void) {
+    asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_SIE));
+    if (profile_active()) {
+        asm volatile("csrc sie, %0" :: "r"(SIE_SEIE));
+        profile_unmask();
+    }
+}
+
+static void scheduler_poll_interrupts(void) {
+    interrupt_window_open();
+    interrupt_window_close();
+}
+
+static void scheduler_wait_interrupt(void) {
+    interrupt_window_open();
+    asm volatile("wfi");
+    interrupt_window_close();
+}
+
+void scheduler_preempt(void) {
+    preempting = 1;
+    scheduler_yield();
+}
+
 void scheduler_yield(void) {
     task_t* current = get_current_task();
+    int preempted = preempting;
+    preempting = 0;
 
     /* Put current task back on ready queue if it's still runnable */
     if (current && current->state == TASK_RUNNING) {
         current->state = TASK_READY;
-        scheduler_add_task(current);
+        scheduler_enqueue(current);
     }
 
     /* Get next task */
     task_t* next = scheduler_get_next_task();
-    if (!next) {
-        /* No ready tasks, keep current if it exists */
-        next = current;
-        if (!next) {
-            /* Nothing to run at all – just return */
-            return;
+
+    /* Only current could run: give pending interrupts a chance first */
+    if (next == current && ready_queue == NULL) {
+        scheduler_poll_interrupts();
+        if (ready_queue) {
+            scheduler_enqueue(next);
+            next = scheduler_get_next_task();
         }
     }
 
+    /*
+     * Everything is blocked: sleep until an interrupt wakes a task. An
+     * exiting task waits here too; its user pages are gone, so it must
+     * never return to its caller.
+     */
+    while (!next && current && current->state != TASK_RUNNING) {
+        perf_switch(current, NULL);     /* Idle time is nobody's */
+        scheduler_wait_interrupt();
+        perf_switch(NULL, current);
+        next = scheduler_get_next_task();
+    }
+
+    if (!next) {
+        /* Only before the first task exists */
+        return;
+    }
+
+    /* A task that was queued has now waited its full latency */
+    if (next->ready_ticks) {
+        uint64_t waited = timer_get_ticks() - next->ready_ticks;
+        hist_add(&next->sched_lat, waited);
+        hist_add(&hart_latency[current_hart()], waited);
+        next->ready_ticks = 0;
+    }
+
     next->state = TASK_RUNNING;
+    if (next == current) {
+        return;
+    }
+    TRACE(TRACE_SCHED_SWITCH, current ? current->pid : 0, next->pid);
+    perf_switch(current, next);
+    if (current) {
+        if (preempted) {
+            current->acct.invol_switches++;
+        } else {
+            current->acct.vol_switches++;
+        }
+    }
     set_current_task(next);
 
-    /* A real context switch (saving/restoring registers) would go here.
-       For now, we just change the current task pointer. */
+    /* Switch address spaces (ASID-tagged, no TLB flush) */
+    if (next->satp) {
+        paging_activate(&next->satp, &next->asid_gen);
+    }
 
-       
+    /* Switch kernel stacks; returns when current is scheduled again */
+    if (current) {
+        context_switch(&current->ctx, &next->ctx);
+    }
+}
+
+void scheduler_latency(const task_t* task, sched_latency_t* out) {
+    const hist_t* h = task ? &task->sched_lat : &hart_latency[current_hart()];
+
+    uint64_t freq = timer_get_freq();
+    out->count = h->count;
+    out->p50_ns = clock_ticks_to_ns(hist_percentile(h, 50), freq);
+    out->p99_ns = clock_ticks_to_ns(hist_percentile(h, 99), freq);
+    out->max_ns = clock_ticks_to_ns(h->max, freq);
+}
+
+void scheduler_latency_reset(void) {
+    memset(hart_latency, 0, sizeof(hart_latency));
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* task = task_at(i);
+        if (task) {
+            memset(&task->sched_lat, 0, sizeof(task->sched_lat));
+        }
+    }
 }
@@ -7,8 +7,17 @@
 #include "scheduler.h"
 #include "timer.h"
 #include "memory.h"
+#include "imgcache.h"
+#include "bench.h"
+#include "clock.h"
+#include "trap.h"
+#include "plic.h"
+#include "log.h"
+#include "trace.h"
+#include "profile.h"
 
 #define INPUT_BUF 128
+#define TOP_ROUNDS 10
 static char input_buf[INPUT_BUF];
 
 /* very simple strtok */
@@ -40,21 +49,42 @@ void shell_help() {
     printf("  cat <file>    - Display file contents\r\n");
     printf("  echo <text>   - Echo text\r\n");
     printf("  ps            - List processes\r\n");
+    printf("  top [n]       - Per-task CPU, faults and I/O, refreshed n times\r\n");
+    printf("  latency [reset] - Wakeup-to-run latency per hart and task\r\n");
     printf("  fork          - Fork current process\r\n");
+    printf("  spawn <file>  - Start a program as a new task\r\n");
     printf("  uptime        - Show OS uptime\r\n");
     printf("  meminfo       - Show memory usage\r\n");
+    printf("  traps         - Show trap counts and latency\r\n");
+    printf("  irqs          - Show device interrupt routing and counts\r\n");
+    printf("  dmesg         - Show the kernel log with timestamps\r\n");
+    printf("  trace <cmd>   - Trace buffer: dump, save <file>, clear\r\n");
+    printf("  profile <cmd> - Sampling profiler: start [hz], stop, dump\r\n");
+    printf("  perf <file>   - Run a program and show its counters\r\n");
+    printf("  bench <name>  - Run a benchmark (tlb, syscall, spawn <file>)\r\n");
     printf("  clear         - Clear screen\r\n");
     printf("  exit          - Exit shell\r\n");
 }
 
 void shell_ls() {
-    char buf[512];
-    int n = fs_list_files(buf, sizeof(buf));
-    if (n <= 0) {
+    uint64_t buf[64];  /* 512 bytes, aligned for fs_dirent_t */
+    uint32_t cursor = 0;
+    int count = 0;
+    int n;
+
+    /* Stream the directory in batches instead of one formatted blob */
+    while ((n = fs_readdir(&cursor, buf, sizeof(buf))) > 0) {
+        for (int pos = 0; pos < n; ) {
+            fs_dirent_t* d = (fs_dirent_t*)((char*)buf + pos);
+            printf("%s%s  %u\r\n", d->name, d->type == 1 ? "/" : "", d->size);
+            pos += d->reclen;
+            count++;
+        }
+    }
+
+    if (count == 0) {
         printf("(no files)\r\n");
-        return;
     }
-    printf("%s\r\n", buf);
 }
 
 void shell_cat(char* filename) {
@@ -76,17 +106,208 @@ void shell_cat(char* filename) {
 }
 
 void shell_ps() {
-    task_t* t = scheduler_get_task_list();
-
     printf("PID   STATE   NAME\r\n");
     printf("--------------------------\r\n");
 
-    while (t) {
-        printf("%d     %d      %s\r\n", t->pid, t->state, t->name);
-        t = t->next;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = task_at(i);
+        if (t)
+            printf("%-5d %-7s %s\r\n", t->pid, task_state_name(t->state), t->name);
+    }
+}
+
+typedef struct {
+    task_t* task;
+    uint64_t cycles;        /* Run time during the last interval */
+} top_row_t;
+
+/* Run time at the previous refresh, by task slot */
+static uint64_t top_last_cycles[MAX_TASKS];
+static int top_last_pid[MAX_TASKS];
+
+static void shell_top_refresh(uint64_t interval) {
+    top_row_t rows[MAX_TASKS];
+    int n = 0;
+
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = task_at(i);
+        if (!t)
+            continue;
+
+        perf_counts_t c;
+        perf_read(t, &c);
+        uint64_t last = top_last_pid[i] == t->pid ? top_last_cycles[i] : 0;
+        top_last_cycles[i] = c.cycles;
+        top_last_pid[i] = t->pid;
+
+        /* Insertion sort, busiest first */
+        int j = n++;
+        while (j > 0 && rows[j - 1].cycles < c.cycles - last) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j].task = t;
+        rows[j].cycles = c.cycles - last;
+    }
+
+    printf("\033[2J\033[H");
+    printf("%-5s %-6s %6s %10s %7s %7s %8s %6s %8s %8s %s\r\n", "PID", "STATE", "CPU%",
+           "MCYCLES", "VCSW", "IVCSW", "SYSCALLS", "FAULTS", "READ", "WRITTEN", "NAME");
+
+    for (int i = 0; i < n; i++) {
+        task_t* t = rows[i].task;
+        perf_counts_t c;
+        perf_read(t, &c);
+        uint64_t permille = interval ? rows[i].cycles * 1000 / interval : 0;
+        printf("%-5d %-6s %4lu.%lu %10lu %7lu %7lu %8lu %6lu %8lu %8lu %s\r\n",
+               t->pid, task_state_name(t->state), permille / 10, permille % 10,
+               c.cycles / 1000000, t->acct.vol_switches, t->acct.invol_switches,
+               t->acct.syscalls, c.faults, t->acct.bytes_read,
+               t->acct.bytes_written, t->name);
+    }
+    printf("Press any key to quit\r\n");
+}
+
+/* Refresh once a second until a key is pressed or count runs out */
+void shell_top(char* arg) {
+    int rounds = arg ? atoi(arg) : TOP_ROUNDS;
+    uint64_t second = timer_get_freq();
+    uint64_t cycles_start;
+
+    for (int i = 0; i < MAX_TASKS; i++)
+        top_last_pid[i] = -1;
+
+    asm volatile("rdcycle %0" : "=r"(cycles_start));
+    shell_top_refresh(0);
+
+    for (int r = 0; r < rounds; r++) {
+        uint64_t deadline = timer_get_ticks() + second;
+        while (timer_get_ticks() < deadline) {
+            if (uart_trygetchar() >= 0)
+                return;
+            task_yield();
+        }
+
+        uint64_t now;
+        asm volatile("rdcycle %0" : "=r"(now));
+        shell_top_refresh(now - cycles_start);
+        cycles_start = now;
     }
 }
 
+void shell_bench(char* name, char* arg) {
+    if (name && strcmp(name, "tlb") == 0)
+        bench_tlb_switch();
+    else if (name && strcmp(name, "spawn") == 0 && arg)
+        bench_spawn(arg);
+    else if (name && strcmp(name, "syscall") == 0)
+        bench_null_syscall();
+    else
+        printf("Usage: bench <tlb | syscall | spawn <file>>\r\n");
+}
+
+void shell_trace(char* op, char* arg) {
+    if (op && strcmp(op, "dump") == 0)
+        trace_dump();
+    else if (op && strcmp(op, "clear") == 0)
+        trace_clear();
+    else if (op && strcmp(op, "save") == 0 && arg) {
+        int n = trace_save(arg);
+        if (n < 0)
+            printf("Error: cannot save trace to %s\r\n", arg);
+        else
+            printf("Saved %d bytes to %s\r\n", n, arg);
+    }
+    else
+        printf("Usage: trace <dump | clear | save <file>>\r\n");
+}
+
+void shell_profile(char* op, char* arg) {
+    if (op && strcmp(op, "start") == 0) {
+        uint32_t hz = arg ? (uint32_t)atoi(arg) : PROFILE_HZ_DEFAULT;
+        if (profile_start(hz) != 0)
+            printf("Error: rate must be 1-%d Hz\r\n", PROFILE_HZ_MAX);
+        else
+            printf("Profiling at %u Hz\r\n", hz);
+    }
+    else if (op && strcmp(op, "stop") == 0)
+        profile_stop();
+    else if (op && strcmp(op, "dump") == 0)
+        profile_dump();
+    else
+        printf("Usage: profile <start [hz] | stop | dump>\r\n");
+}
+
+static void shell_latency_row(const char* label, const task_t* task, const char* name) {
+    sched_latency_t lat;
+    scheduler_latency(task, &lat);
+    if (lat.count == 0)
+        return;
+
+    printf("%-6s %8lu %6lu.%03lu %6lu.%03lu %6lu.%03lu  %s\r\n", label, lat.count,
+           lat.p50_ns / 1000, lat.p50_ns % 1000, lat.p99_ns / 1000, lat.p99_ns % 1000,
+           lat.max_ns / 1000, lat.max_ns % 1000, name);
+}
+
+/* Ready-to-dispatch delay in microseconds, hart first, then each task */
+void shell_latency(char* arg) {
+    if (arg && strcmp(arg, "reset") == 0) {
+        scheduler_latency_reset();
+        return;
+    }
+
+    printf("%-6s %8s %10s %10s %10s  %s\r\n", "PID", "WAKEUPS", "P50 us", "P99 us",
+           "MAX us", "NAME");
+    shell_latency_row("hart", NULL, "");
+
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = task_at(i);
+        if (!t)
+            continue;
+        char pid[12];
+        snprintf(pid, sizeof(pid), "%d", t->pid);
+        shell_latency_row(pid, t, t->name);
+    }
+}
+
+void shell_perf(char* filename) {
+    if (!filename) {
+        printf("Usage: perf <file>\r\n");
+        return;
+    }
+
+    uint64_t start = timer_get_ticks();
+    int pid = task_spawn(filename, NULL);
+    if (pid < 0) {
+        printf("Error: cannot run %s\r\n", filename);
+        return;
+    }
+
+    perf_counts_t c;
+    int code = task_wait_perf(pid, &c);
+    uint64_t us = timer_ticks_to_us(timer_get_ticks() - start);
+    uint64_t ipc = c.cycles ? c.instret * 100 / c.cycles : 0;
+
+    printf("Counters for %s (pid %d, exit %d):\r\n", filename, pid, code);
+    printf("  %lu cycles\r\n", c.cycles);
+    printf("  %lu instructions  # %lu.%02lu IPC\r\n", c.instret, ipc / 100, ipc % 100);
+    printf("  %lu page faults\r\n", c.faults);
+    printf("  %lu us elapsed\r\n", us);
+}
+
+void shell_spawn(char* filename) {
+    if (!filename) {
+        printf("Usage: spawn <file>\r\n");
+        return;
+    }
+
+    int pid = task_spawn(filename, NULL);
+    if (pid < 0)
+        printf("Error: cannot run %s\r\n", filename);
+    else
+        printf("Spawned %s: %d\r\n", filename, pid);
+}
+
 void shell_start() {
     printf("RISC-V OS Shell v1.0\r\n");
     printf("Type 'help' for commands\r\n");
@@ -99,6 +320,9 @@ void shell_start() {
         while (1) {
             char c = uart_getchar();
 
+            /* klogd may not have shown the prompt yet */
+            log_flush();
+
             if (c == '\r' || c == '\n') {
                 uart_putchar('\r');
                 uart_putchar('\n');
@@ -135,6 +359,12 @@ void shell_start() {
         else if (strcmp(cmd, "ps") == 0)
             shell_ps();
 
+        else if (strcmp(cmd, "top") == 0)
+            shell_top(args);
+
+        else if (strcmp(cmd, "latency") == 0)
+            shell_latency(args);
+
         else if (strcmp(cmd, "fork") == 0) {
             int pid = task_fork();
             if (pid == 0)
@@ -145,14 +375,48 @@ void shell_start() {
 
         else if (strcmp(cmd, "uptime") == 0) {
             uint64_t ticks = timer_get_ticks();
-            printf("Uptime: %lu ticks\r\n", ticks);
+            const clock_page_t* cp = timer_clock_page();
+            if (cp) {
+                uint64_t ns = clock_uptime_ns(cp);
+                printf("Uptime: %lu ticks (%lu.%03lu s)\r\n", ticks,
+                       ns / NSEC_PER_SEC, (ns % NSEC_PER_SEC) / 1000000);
+            } else {
+                printf("Uptime: %lu ticks\r\n", ticks);
+            }
         }
 
         else if (strcmp(cmd, "meminfo") == 0) {
             uint64_t mem = mem_get_allocated();
             printf("Memory allocated: %lu bytes\r\n", mem);
+
+            uint64_t hits, misses;
+            int pages;
+            imgcache_stats(&hits, &misses, &pages);
+            printf("Image cache: %d pages, %lu hits, %lu misses\r\n", pages, hits, misses);
         }
 
+        else if (strcmp(cmd, "dmesg") == 0)
+            log_dump();
+        else if (strcmp(cmd, "irqs") == 0)
+            plic_dump();
+        else if (strcmp(cmd, "traps") == 0)
+            trap_dump_stats();
+
+        else if (strcmp(cmd, "perf") == 0)
+            shell_perf(args);
+
+        else if (strcmp(cmd, "profile") == 0)
+            shell_profile(args, strtok_simple(NULL, ' '));
+
+        else if (strcmp(cmd, "trace") == 0)
+            shell_trace(args, strtok_simple(NULL, ' '));
+
+        else if (strcmp(cmd, "spawn") == 0)
+            shell_spawn(args);
+
+        else if (strcmp(cmd, "bench") == 0)
+            shell_bench(args, strtok_simple(NULL, ' '));
+
         else if (strcmp(cmd, "clear") == 0)
             printf("\033[2J\033[H");
 
@@ -110,3 +110,12 @@ char* strtok(char* str, const char* delim) {
     return start;
 }
 
+
+/* Decimal digits only; stops at the first non-digit */
+int atoi(const char* s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+    }
+    return n;
+}
@@ -1,4 +1,6 @@
 #include "sync.h"
+#include "task.h"
+#include "scheduler.h"
 #include "types.h"
 
 /* Spinlock implementation */
@@ -61,3 +63,53 @@ void mutex_unlock(mutex_t* mutex) {
     mutex->count--;
     __sync_lock_release(&mutex->locked);
 }
+
+/* Wait queues */
+void wait_queue_init(wait_queue_t* wq) {
+    wq->head = NULL;
+}
+
+/*
+ * Block the current task until wait_queue_wake_all. The kernel runs with
+ * interrupts off, so the caller's check of its condition cannot race
+ * with the handler that wakes it.
+ */
+void wait_queue_sleep(wait_queue_t* wq) {
+    task_t* task = get_current_task();
+
+    task->state = TASK_BLOCKED;
+    task->waiting_on = wq;
+    task->wait_next = wq->head;
+    wq->head = task;
+
+    scheduler_yield();
+}
+
+void wait_queue_wake_all(wait_queue_t* wq) {
+    task_t* task = wq->head;
+    wq->head = NULL;
+
+    while (task) {
+        task_t* next = task->wait_next;
+        task->wait_next = NULL;
+        task->waiting_on = NULL;
+        if (task->state == TASK_BLOCKED) {
+            task->state = TASK_READY;
+            scheduler_add_task(task);
+        }
+        task = next;
+    }
+}
+
+void wait_queue_remove(wait_queue_t* wq, struct task* task) {
+    task_t** link = &wq->head;
+    while (*link) {
+        if (*link == task) {
+            *link = task->wait_next;
+            break;
+        }
+        link = &(*link)->wait_next;
+    }
+    task->wait_next = NULL;
+    task->waiting_on = NULL;
+}
@@ -1,83 +1,364 @@
 #include "kernel.h"
+#include "syscall.h"
 #include "task.h"
 #include "fs.h"
 #include "uart.h"
+#include "uaccess.h"
+#include "memory.h"
+#include "uring.h"
+#include "trace.h"
+#include "profile.h"
+#include "perf.h"
+#include "scheduler.h"
 #include "types.h"
 
-/* System call handler */
-uint64_t syscall_handler(uint64_t syscall_num,
-                         uint64_t arg1,
-                         uint64_t arg2,
-                         uint64_t arg3) {
-    switch (syscall_num) {
-        case SYS_EXIT:
-            task_exit((int)arg1);
-            return 0;
-
-        case SYS_WRITE: {
-            int fd = (int)arg1;
-            const char* buf = (const char*)arg2;
-            size_t count = (size_t)arg3;
-
-            if (fd == 1 || fd == 2) {  /* stdout/stderr */
-                for (size_t i = 0; i < count; i++) {
-                    uart_putchar(buf[i]);
-                }
-                return count;
+/* Console I/O goes through a small stack buffer */
+#define CONSOLE_CHUNK 256
+
+/* So do file writes and directory listings; one chunk holds any dirent */
+#define FS_CHUNK 512
+_Static_assert(FS_DIRENT_RECLEN(MAX_FILENAME - 1) <= FS_CHUNK, "dirent fits a chunk");
+
+static uint64_t sys_exit(const uint64_t* args) {
+    task_exit((int)args[0]);
+    return 0;
+}
+
+static uint64_t sys_write(const uint64_t* args) {
+    int fd = (int)args[0];
+    const char* buf = (const char*)args[1];
+    size_t count = (size_t)args[2];
+    char chunk[CONSOLE_CHUNK];
+
+    if (fd == 1 || fd == 2) {  /* stdout/stderr */
+        for (size_t done = 0; done < count; ) {
+            size_t n = count - done < CONSOLE_CHUNK ? count - done : CONSOLE_CHUNK;
+            if (copy_from_user(chunk, buf + done, n) != 0) {
+                return done ? done : (uint64_t)-1;
             }
-            return (uint64_t)-1;
+            uart_write(chunk, n);
+            done += n;
         }
+        return count;
+    }
+    return (uint64_t)-1;
+}
 
-        case SYS_READ: {
-            int fd = (int)arg1;
-            char* buf = (char*)arg2;
-            size_t count = (size_t)arg3;
+static uint64_t sys_read(const uint64_t* args) {
+    int fd = (int)args[0];
+    char* buf = (char*)args[1];
+    size_t count = (size_t)args[2];
+    char chunk[CONSOLE_CHUNK];
 
-            if (fd == 0) {  /* stdin */
-                for (size_t i = 0; i < count; i++) {
-                    buf[i] = uart_getchar();
-                }
-                return count;
+    if (fd == 0) {  /* stdin */
+        for (size_t done = 0; done < count; ) {
+            size_t n = count - done < CONSOLE_CHUNK ? count - done : CONSOLE_CHUNK;
+            for (size_t i = 0; i < n; i++) {
+                chunk[i] = uart_getchar();
             }
-            return (uint64_t)-1;
+            if (copy_to_user(buf + done, chunk, n) != 0) {
+                return done ? done : (uint64_t)-1;
+            }
+            done += n;
         }
+        return count;
+    }
+    return (uint64_t)-1;
+}
+
+static uint64_t sys_fork(const uint64_t* args) {
+    (void)args;
+    return (uint64_t)task_fork();
+}
 
-        case SYS_FORK:
-            return (uint64_t)task_fork();
+/* Kernel copy of a user argv; the program loader reads it after the
+ * caller's address space may already be gone */
+typedef struct {
+    char* argv[TASK_MAX_ARGS + 1];
+    char strings[TASK_MAX_ARGS][TASK_ARG_LEN];
+} kernel_argv_t;
 
-        case SYS_EXEC: {
-            const char* path = (const char*)arg1;
-            char** argv = (char**)arg2;
-            return (uint64_t)task_exec(path, argv);
+static kernel_argv_t* argv_from_user(char* const* user_argv) {
+    kernel_argv_t* k = kmalloc(sizeof(*k));
+    if (!k) {
+        return NULL;
+    }
+
+    for (int i = 0; ; i++) {
+        char* arg;
+        if (copy_from_user(&arg, &user_argv[i], sizeof(arg)) != 0 ||
+            (arg && i == TASK_MAX_ARGS)) {
+            kfree(k);
+            return NULL;
+        }
+        k->argv[i] = NULL;
+        if (!arg) {
+            return k;
         }
+        if (strncpy_from_user(k->strings[i], arg, TASK_ARG_LEN) < 0) {
+            kfree(k);
+            return NULL;
+        }
+        k->argv[i] = k->strings[i];
+    }
+}
 
-        case SYS_WAIT: {
-            int pid = (int)arg1;
-            return (uint64_t)task_wait(pid);
+/* Run fn(path, argv) with both copied in; a NULL argv stays NULL */
+static uint64_t sys_load_program(const uint64_t* args,
+                                 int (*fn)(const char*, char**)) {
+    char path[MAX_FILENAME];
+    char* const* user_argv = (char* const*)args[1];
+    kernel_argv_t* k = NULL;
+
+    if (strncpy_from_user(path, (const char*)args[0], sizeof(path)) < 0) {
+        return (uint64_t)-1;
+    }
+    if (user_argv) {
+        k = argv_from_user(user_argv);
+        if (!k) {
+            return (uint64_t)-1;
         }
+    }
+
+    int ret = fn(path, k ? k->argv : NULL);
+    kfree(k);
+    return (uint64_t)ret;
+}
+
+static uint64_t sys_exec(const uint64_t* args) {
+    return sys_load_program(args, task_exec);
+}
+
+static uint64_t sys_wait(const uint64_t* args) {
+    int pid = (int)args[0];
+    return (uint64_t)task_wait(pid);
+}
+
+static uint64_t sys_open_close(const uint64_t* args) {
+    (void)args;
+    /* File descriptor ops not implemented yet */
+    return 0;
+}
+
+/*
+ * The filesystem image is memory-mapped, so reads copy straight from it
+ * to the user buffer.
+ */
+static uint64_t sys_read_fs(const uint64_t* args) {
+    char path[MAX_FILENAME];
+    void* buf = (void*)args[1];
+    uint32_t size = (uint32_t)args[2];
+
+    if (strncpy_from_user(path, (const char*)args[0], sizeof(path)) < 0) {
+        return (uint64_t)-1;
+    }
+    file_entry_t* entry = fs_find_file(path);
+    if (!entry) {
+        return (uint64_t)-1;
+    }
+
+    /* For now, always read from offset 0 */
+    if (size > entry->size) {
+        size = entry->size;
+    }
+    if (copy_to_user(buf, fs_entry_data(entry), size) != 0) {
+        return (uint64_t)-1;
+    }
+    return size;
+}
+
+/* Writes are staged in a stack chunk so only the user side can fault */
+static uint64_t sys_write_fs(const uint64_t* args) {
+    char path[MAX_FILENAME];
+    const char* buf = (const char*)args[1];
+    uint32_t size = (uint32_t)args[2];
+    char chunk[FS_CHUNK];
+
+    if (strncpy_from_user(path, (const char*)args[0], sizeof(path)) < 0) {
+        return (uint64_t)-1;
+    }
+    if (size == 0) {
+        return (uint64_t)fs_write_file(path, NULL, 0, 0);
+    }
+
+    /* Create it at full size, or the first chunk would size its blocks */
+    if (!fs_find_file(path) && fs_create_file(path, size) != 0) {
+        return (uint64_t)-1;
+    }
 
-        case SYS_OPEN:
-        case SYS_CLOSE:
-            /* File descriptor ops not implemented yet */
-            return 0;
-
-        case SYS_READ_FS: {
-            const char* path = (const char*)arg1;
-            void* buf = (void*)arg2;
-            uint32_t size = (uint32_t)arg3;
-            /* For now, always read from offset 0 */
-            return (uint64_t)fs_read_file(path, buf, size, 0);
+    /* For now, always write from offset 0 */
+    for (uint32_t done = 0; done < size; ) {
+        uint32_t n = size - done < FS_CHUNK ? size - done : FS_CHUNK;
+        if (copy_from_user(chunk, buf + done, n) != 0 ||
+            fs_write_file(path, chunk, n, done) != (int)n) {
+            return done ? done : (uint64_t)-1;
         }
+        done += n;
+    }
+    return size;
+}
+
+static uint64_t sys_readdir(const uint64_t* args) {
+    uint32_t* cursor = (uint32_t*)args[0];
+    char* buf = (char*)args[1];
+    size_t size = (size_t)args[2];
+    uint32_t kcursor;
+    uint64_t chunk[FS_CHUNK / sizeof(uint64_t)];    /* fs_dirent_t aligned */
+
+    if (copy_from_user(&kcursor, cursor, sizeof(kcursor)) != 0) {
+        return (uint64_t)-1;
+    }
 
-        case SYS_WRITE_FS: {
-            const char* path = (const char*)arg1;
-            const void* buf = (const void*)arg2;
-            uint32_t size = (uint32_t)arg3;
-            /* For now, always write from offset 0 */
-            return (uint64_t)fs_write_file(path, buf, size, 0);
+    /* Fill the user buffer a chunk at a time; the cursor carries over.
+     * A zero size still asks fs_readdir, which tells end from no room. */
+    size_t done = 0;
+    do {
+        size_t want = size - done < FS_CHUNK ? size - done : FS_CHUNK;
+        int n = fs_readdir(&kcursor, chunk, want);
+        if (n < 0) {
+            if (done == 0) {
+                return (uint64_t)-1;  /* Not even one entry fits */
+            }
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (copy_to_user(buf + done, chunk, n) != 0) {
+            return (uint64_t)-1;
         }
+        done += n;
+    } while (done < size);
+
+    if (copy_to_user(cursor, &kcursor, sizeof(kcursor)) != 0) {
+        return (uint64_t)-1;
+    }
+    return done;
+}
+
+static uint64_t sys_spawn(const uint64_t* args) {
+    return sys_load_program(args, task_spawn);
+}
+
+static uint64_t sys_getpid(const uint64_t* args) {
+    (void)args;
+    return (uint64_t)get_current_task()->pid;
+}
+
+/* Counters of a task (pid 0 = caller) into a user perf_counts_t */
+static uint64_t sys_perf_read(const uint64_t* args) {
+    int pid = (int)args[0];
+    task_t* task = pid ? task_find(pid) : get_current_task();
+    perf_counts_t counts;
+
+    if (!task) {
+        return (uint64_t)-1;
+    }
+    perf_read(task, &counts);
+    if (copy_to_user((void*)args[1], &counts, sizeof(counts)) != 0) {
+        return (uint64_t)-1;
+    }
+    return 0;
+}
+
+/* Latency summary of a task (pid 0 = caller, -1 = this hart) */
+static uint64_t sys_sched_latency(const uint64_t* args) {
+    int pid = (int)args[0];
+    task_t* task = NULL;
+    sched_latency_t lat;
 
-        default:
+    if (pid >= 0) {
+        task = pid ? task_find(pid) : get_current_task();
+        if (!task) {
             return (uint64_t)-1;
+        }
+    }
+    scheduler_latency(task, &lat);
+    if (copy_to_user((void*)args[1], &lat, sizeof(lat)) != 0) {
+        return (uint64_t)-1;
+    }
+    return 0;
+}
+
+static uint64_t sys_uring_setup(const uint64_t* args) {
+    (void)args;
+    return (uint64_t)uring_setup();
+}
+
+static uint64_t sys_uring_enter(const uint64_t* args) {
+    return (uint64_t)uring_enter((uint32_t)args[0]);
+}
+
+/* Indexed by syscall number (a7); empty slots return -1 */
+static const syscall_fn_t syscall_table[NR_SYSCALLS] = {
+    [SYS_EXIT]        = sys_exit,
+    [SYS_WRITE]       = sys_write,
+    [SYS_READ]        = sys_read,
+    [SYS_FORK]        = sys_fork,
+    [SYS_EXEC]        = sys_exec,
+    [SYS_WAIT]        = sys_wait,
+    [SYS_OPEN]        = sys_open_close,
+    [SYS_CLOSE]       = sys_open_close,
+    [SYS_READ_FS]     = sys_read_fs,
+    [SYS_WRITE_FS]    = sys_write_fs,
+    [SYS_READDIR]     = sys_readdir,
+    [SYS_SPAWN]       = sys_spawn,
+    [SYS_GETPID]      = sys_getpid,
+    [SYS_URING_SETUP] = sys_uring_setup,
+    [SYS_URING_ENTER] = sys_uring_enter,
+    [SYS_PERF_READ]   = sys_perf_read,
+    [SYS_SCHED_LATENCY] = sys_sched_latency,
+};
+
+/* Per-task counts for top; uring entries are counted one by one */
+static void syscall_account(uint64_t num, uint64_t ret) {
+    task_t* task = get_current_task();
+    if (!task) {
+        return;
+    }
+
+    task->acct.syscalls++;
+    if ((int64_t)ret <= 0) {
+        return;
     }
+    if (num == SYS_READ || num == SYS_READ_FS) {
+        task->acct.bytes_read += ret;
+    } else if (num == SYS_WRITE || num == SYS_WRITE_FS) {
+        task->acct.bytes_written += ret;
+    }
+}
+
+/* System call handler */
+uint64_t syscall_handler(uint64_t syscall_num, const uint64_t* args) {
+    if (syscall_num >= NR_SYSCALLS || !syscall_table[syscall_num]) {
+        return (uint64_t)-1;
+    }
+
+    uint64_t ret = syscall_table[syscall_num](args);
+    syscall_account(syscall_num, ret);
+    return ret;
+}
+
+/* Arguments are a0..a5 in place in the frame */
+void syscall_dispatch(trapframe_t* tf) {
+    /* Resume after the ecall instruction */
+    uint64_t num = tf->regs[17];
+
+    profile_unmask();
+    TRACE(TRACE_SYSCALL_ENTER, num, 0);
+    tf->sepc += 4;
+    tf->regs[10] = syscall_handler(num, &tf->regs[10]);
+    TRACE(TRACE_SYSCALL_EXIT, num, tf->regs[10]);
+}
+
+/*
+ * Fast path for user ecalls: boot/trap.S calls this directly instead of
+ * going through trap_handler, and it returns straight to the caller's
+ * frame. It still counts as an ecall in the per-cause trap stats.
+ */
+trapframe_t* syscall_entry(trapframe_t* tf) {
+    uint64_t start = trap_stat_start();
+    syscall_dispatch(tf);
+    trap_stat_end(0, EXC_ECALL_U, start);
+    return tf;
 }
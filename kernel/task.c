@@ -6,6 +6,10 @@
 #include "string.h"
 #include "types.h"
 #include "scheduler.h"
+#include "elf.h"
+#include "timer.h"
+#include "clock.h"
+#include "trace.h"
 
 static task_t tasks[MAX_TASKS];
 static int next_pid = 1;
@@ -13,6 +17,30 @@ static task_t* current_task = NULL;
 static task_t* task_list = NULL;
 static spinlock_t task_lock;
 
+/* Kernel stacks come from kmalloc, which only aligns to 8 bytes */
+static inline uint64_t task_stack_top(task_t* task) {
+    return ((uint64_t)task->stack + KERNEL_STACK_SIZE) & ~0xFUL;
+}
+
+void trap_return(trapframe_t* tf) __attribute__((noreturn));
+
+/*
+ * First code every new task runs (via its saved context). Tasks with a
+ * user image drop to user mode through the trap exit path; kernel tasks
+ * run their entry function.
+ */
+static void task_start(void) {
+    task_t* self = current_task;
+
+    if (self->tf.kernel_sp) {
+        trap_return(&self->tf);
+    }
+    if (self->pc) {
+        ((void (*)(void))self->pc)();
+    }
+    task_exit(0);
+}
+
 void task_init(void) {
     memset(tasks, 0, sizeof(tasks));
     spinlock_init(&task_lock);
@@ -23,6 +51,8 @@ void task_init(void) {
     current_task->ppid = 0;
     strcpy(current_task->name, "idle");
     current_task->state = TASK_RUNNING;
+    current_task->page_table = paging_kernel_root();
+    current_task->satp = paging_kernel_satp();
     current_task->next = NULL;
     current_task->prev = NULL;
     task_list = current_task;
@@ -34,7 +64,7 @@ task_t* task_create(const char* name, void (*entry)(void)) {
     /* Find free task slot */
     task_t* task = NULL;
     for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == 0 || tasks[i].state == TASK_ZOMBIE) {
+        if (tasks[i].state == TASK_UNUSED || tasks[i].state == TASK_ZOMBIE) {
             task = &tasks[i];
             break;
         }
@@ -44,6 +74,11 @@ task_t* task_create(const char* name, void (*entry)(void)) {
         spinlock_unlock(&task_lock);
         return NULL;
     }
+
+    /* An unreaped zombie still owns the kernel stack it exited on */
+    if (task->stack) {
+        kfree(task->stack);
+    }
     
     /* Initialize task */
     memset(task, 0, sizeof(task_t));
@@ -52,21 +87,39 @@ task_t* task_create(const char* name, void (*entry)(void)) {
     strncpy(task->name, name, TASK_NAME_LEN - 1);
     task->state = TASK_READY;
     
-    /* Allocate stack */
-    task->stack = get_free_page();
+    /* Allocate stack (KERNEL_STACK_SIZE spans several pages) */
+    task->stack = kmalloc(KERNEL_STACK_SIZE);
     if (!task->stack) {
+        task->state = TASK_UNUSED;
         spinlock_unlock(&task_lock);
         return NULL;
     }
     
-    /* Set up stack pointer */
-    task->sp = (uint64_t)task->stack + KERNEL_STACK_SIZE;
+    /* Set up stack pointer; the first switch to the task enters task_start */
+    task->sp = task_stack_top(task);
+    task->ctx.sp = task->sp;
+    task->ctx.ra = (uint64_t)task_start;
     
     /* Set up entry point */
     task->pc = (uint64_t)entry;
     
-    /* Set up page table */
+    /* Set up page table: shared kernel slots, empty user window */
     task->page_table = setup_page_table();
+    if (!task->page_table) {
+        kfree(task->stack);
+        task->stack = NULL;
+        task->state = TASK_UNUSED;
+        spinlock_unlock(&task_lock);
+        return NULL;
+    }
+    task->satp = MAKE_SATP(task->page_table);
+
+    /* Read-only clock data for user timestamps (include/clock.h) */
+    void* clock = timer_clock_page();
+    if (clock) {
+        paging_map(task->page_table, CLOCK_PAGE_BASE, (uint64_t)clock,
+                   PTE_R | PTE_U | PTE_A);
+    }
     
     /* Add to task list */
     task->next = task_list;
@@ -75,35 +128,52 @@ task_t* task_create(const char* name, void (*entry)(void)) {
     }
     task_list = task;
     task->prev = NULL;
+
+    TRACE(TRACE_TASK_CREATE, task->pid, task->ppid);
     
     spinlock_unlock(&task_lock);
     return task;
 }
 
+/* Release a task's memory and unlink it. Caller holds task_lock. */
+static void task_release(task_t* task) {
+    vm_space_release(task);
+
+    /* A task cannot free the stack it is running on; that waits for reaping */
+    if (task->stack && task != current_task) {
+        kfree(task->stack);
+        task->stack = NULL;
+    }
+    if (task->page_table) {
+        /* Leave the table before freeing it */
+        if (task == current_task) {
+            paging_switch(paging_kernel_satp());
+        }
+        paging_free_table(task->page_table);
+        task->page_table = NULL;
+    }
+    
+    /* Remove from list */
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        task_list = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    }
+}
+
 void task_exit(int code) {
     spinlock_lock(&task_lock);
     
     if (current_task) {
+        TRACE(TRACE_TASK_EXIT, current_task->pid, code);
         current_task->state = TASK_ZOMBIE;
         current_task->exit_code = code;
         
         /* Free resources */
-        if (current_task->stack) {
-            free_page(current_task->stack);
-        }
-        if (current_task->page_table) {
-            free_page(current_task->page_table);
-        }
-        
-        /* Remove from list */
-        if (current_task->prev) {
-            current_task->prev->next = current_task->next;
-        } else {
-            task_list = current_task->next;
-        }
-        if (current_task->next) {
-            current_task->next->prev = current_task->prev;
-        }
+        task_release(current_task);
     }
     
     spinlock_unlock(&task_lock);
@@ -125,45 +195,239 @@ void set_current_task(task_t* task) {
 }
 
 int task_fork(void) {
-    /* Simplified fork - just create a new task */
-    task_t* child = task_create("forked", NULL);
+    task_t* parent = current_task;
+    if (!parent) {
+        return -1;
+    }
+
+    task_t* child = task_create(parent->name, NULL);
     if (!child) {
         return -1;
     }
+
+    /* Share the address space copy-on-write */
+    if (vm_space_fork(parent, child) != 0) {
+        spinlock_lock(&task_lock);
+        task_release(child);
+        child->state = TASK_UNUSED;  /* Free the slot */
+        spinlock_unlock(&task_lock);
+        return -1;
+    }
     
-    /* Copy parent's context */
-    if (current_task) {
-        memcpy(child->regs, current_task->regs, sizeof(current_task->regs));
-        child->pc = current_task->pc;
-        child->sp = current_task->sp;
+    /* Copy parent's context; the child keeps its own kernel stack */
+    child->tf = parent->tf;
+    child->tf.regs[10] = 0;  /* fork() returns 0 in the child (a0) */
+    if (child->tf.kernel_sp) {
+        child->tf.kernel_sp = task_stack_top(child);
     }
+    child->pc = parent->pc;
+
+    scheduler_add_task(child);
     
     return child->pid;
 }
 
-int task_exec(const char* path, char** argv) {
-    /* Load and execute program */
+/*
+ * Lay out argv in page, the future top page of the user stack: the
+ * strings first, then the NULL-terminated pointer array at a 16-byte
+ * aligned sp. The program starts with a0 = argc and a1 = argv. argv is
+ * kernel memory; NULL passes just the path as argv[0].
+ */
+static int task_push_args(uint8_t* page, const char* path, char** argv,
+                          int* argc_out, uint64_t* sp) {
+    const char* fallback[2] = { path, NULL };
+    char* const* args = argv ? argv : (char* const*)fallback;
+    uint64_t page_va = USER_STACK_TOP - PAGE_SIZE;
+    uint64_t ptrs[TASK_MAX_ARGS + 1];
+    size_t top = PAGE_SIZE;
+    int argc = 0;
+
+    for (; args[argc]; argc++) {
+        size_t len = strlen(args[argc]) + 1;
+        if (argc == TASK_MAX_ARGS || len > top) {
+            return -1;
+        }
+        top -= len;
+        memcpy(page + top, args[argc], len);
+        ptrs[argc] = page_va + top;
+    }
+    ptrs[argc] = 0;
+
+    size_t ptrs_size = (argc + 1) * sizeof(uint64_t);
+    top &= ~(size_t)15;
+    if (ptrs_size > top) {
+        return -1;
+    }
+    top = (top - ptrs_size) & ~(size_t)15;
+    memcpy(page + top, ptrs, ptrs_size);
+
+    *sp = page_va + top;
+    *argc_out = argc;
+    return 0;
+}
+
+/*
+ * Replace task's image with the program at path. Only the segments are
+ * recorded; pages are loaded when first touched, except the stack page
+ * that receives argv. Everything that can fail happens before the old
+ * image is dropped, so a failed exec returns to the caller intact.
+ */
+int task_load_image(task_t* task, const char* path, char** argv) {
+    uint64_t arg_va = USER_STACK_TOP - PAGE_SIZE;
+    vm_space_t vm;
     uint64_t entry;
-    if (elf_load(path, &entry) != 0) {
+    vm_space_init(&vm);
+    if (elf_map(path, &vm, &entry) != 0) {
         return -1;
     }
-    
-    if (current_task) {
-        current_task->pc = entry;
-        /* Reset stack */
-        current_task->sp = (uint64_t)current_task->stack + KERNEL_STACK_SIZE;
+
+    /* Zero-filled user stack at the top of the user window */
+    if (vm_map_file(&vm, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE,
+                    NULL, 0, 0, VM_READ | VM_WRITE) != 0) {
+        return -1;
     }
-    
+
+    uint8_t* arg_page = get_free_page();
+    if (!arg_page) {
+        return -1;
+    }
+    memset(arg_page, 0, PAGE_SIZE);
+
+    int argc;
+    uint64_t sp;
+    /* Allocating the table path now means mapping the page cannot fail */
+    if (task_push_args(arg_page, path, argv, &argc, &sp) != 0 ||
+        !paging_walk(task->page_table, arg_va, 1)) {
+        free_page(arg_page);
+        return -1;
+    }
+
+    /* Drop the old image before installing the new one */
+    vm_space_release(task);
+    task->vm = vm;
+    vm_map_page(task, arg_va, arg_page);
+
+    task_setup_user(task, entry, sp);
+    task->tf.regs[10] = (uint64_t)argc;
+    task->tf.regs[11] = sp;
+    return 0;
+}
+
+/* Fresh user context: sret lands on entry in user mode with the given sp */
+void task_setup_user(task_t* task, uint64_t entry, uint64_t user_sp) {
+    memset(&task->tf, 0, sizeof(task->tf));
+    task->tf.sepc = entry;
+    task->tf.sstatus = SSTATUS_SPIE;
+    task->tf.regs[2] = user_sp;
+    task->tf.kernel_sp = task_stack_top(task);
+    /* Reset stack */
+    task->sp = task_stack_top(task);
+}
+
+int task_exec(const char* path, char** argv) {
+    if (!current_task) {
+        return -1;
+    }
+
+    if (task_load_image(current_task, path, argv) != 0) {
+        return -1;
+    }
+    /* The syscall return value lands in a0, so hand back argc */
+    return (int)current_task->tf.regs[10];
+}
+
+/* Return the last path component, used as the task name */
+static const char* path_basename(const char* path) {
+    const char* base = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+    return base;
+}
+
+/*
+ * Create a task running the program at path. The image goes straight
+ * into the new, empty address space, so unlike fork+exec nothing of the
+ * caller's address space is shared and then thrown away.
+ */
+int task_spawn(const char* path, char** argv) {
+    task_t* task = task_create(path_basename(path), NULL);
+    if (!task) {
+        return -1;
+    }
+
+    if (task_load_image(task, path, argv) != 0) {
+        spinlock_lock(&task_lock);
+        task_release(task);
+        task->state = TASK_UNUSED;  /* Free the slot */
+        spinlock_unlock(&task_lock);
+        return -1;
+    }
+
+    scheduler_add_task(task);
+    return task->pid;
+}
+
+task_t* task_find(int pid) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].state != TASK_UNUSED && tasks[i].pid == pid) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+task_t* task_at(int slot) {
+    if (slot < 0 || slot >= MAX_TASKS || tasks[slot].state == TASK_UNUSED) {
+        return NULL;
+    }
+    return &tasks[slot];
+}
+
+const char* task_state_name(task_state_t state) {
+    switch (state) {
+    case TASK_RUNNING: return "RUN";
+    case TASK_READY:   return "READY";
+    case TASK_BLOCKED: return "BLOCK";
+    case TASK_ZOMBIE:  return "ZOMBIE";
+    default:           return "?";
+    }
+}
+
+/* Tear down another task immediately without waiting for it */
+int task_kill(int pid) {
+    task_t* task = task_find(pid);
+    if (!task || task == current_task || task->state == TASK_ZOMBIE) {
+        return -1;
+    }
+
+    scheduler_remove_task(task);
+    if (task->waiting_on) {
+        wait_queue_remove(task->waiting_on, task);
+    }
+
+    spinlock_lock(&task_lock);
+    task_release(task);
+    task->state = TASK_UNUSED;  /* Free the slot */
+    spinlock_unlock(&task_lock);
     return 0;
 }
 
 int task_wait(int pid) {
+    return task_wait_perf(pid, NULL);
+}
+
+/* task_wait that also returns the child's final counters */
+int task_wait_perf(int pid, perf_counts_t* counts) {
     /* Wait for child process to exit */
     spinlock_lock(&task_lock);
     
     task_t* child = NULL;
     for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].pid == pid && tasks[i].ppid == (current_task ? current_task->pid : 0)) {
+        if (tasks[i].state != TASK_UNUSED && tasks[i].pid == pid &&
+            tasks[i].ppid == (current_task ? current_task->pid : 0)) {
             child = &tasks[i];
             break;
         }
@@ -174,15 +438,26 @@ int task_wait(int pid) {
         return -1;
     }
     
-    /* Wait for zombie state */
+    /* Wait for zombie state; a killed or reaped child frees its slot */
     while (child->state != TASK_ZOMBIE) {
+        if (child->state == TASK_UNUSED || child->pid != pid) {
+            spinlock_unlock(&task_lock);
+            return -1;
+        }
         spinlock_unlock(&task_lock);
         task_yield();
         spinlock_lock(&task_lock);
     }
     
     int exit_code = child->exit_code;
-    child->state = 0;  /* Free the slot */
+    if (counts) {
+        *counts = child->perf.total;
+    }
+    if (child->stack) {
+        kfree(child->stack);
+        child->stack = NULL;
+    }
+    child->state = TASK_UNUSED;  /* Free the slot */
     
     spinlock_unlock(&task_lock);
     return exit_code;
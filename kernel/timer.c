@@ -1,13 +1,80 @@
 // kernel/timer.c
 #include "timer.h"
+#include "clock.h"
+#include "memory.h"
+#include "sbi.h"
+#include "string.h"
+#include "trap.h"
 #include "types.h"
 
+// QEMU virt: time CSR runs at 10 MHz
+#define TIMER_FREQ 10000000UL
+
+// Preemption tick; user code runs at most this long before a switch
+#define TIMER_TICK_HZ 100
+
+// Goldfish RTC: nanoseconds since the epoch; reading TIME_LOW latches TIME_HIGH
+#define RTC_MMIO      0x00101000UL
+#define RTC_TIME_LOW  0x00
+#define RTC_TIME_HIGH 0x04
+
+// Shared with every task read-only at CLOCK_PAGE_BASE
+static volatile clock_page_t* clock_page = NULL;
+
+// One comparator, shared by the scheduler tick and the profiler
+static uint64_t tick_period;
+static uint64_t next_tick;
+static uint64_t next_sample = ~0UL;
+
+static void timer_program(void) {
+    sbi_set_timer(next_sample < next_tick ? next_sample : next_tick);
+}
+
+static uint64_t rtc_read_ns(void) {
+    volatile uint32_t* rtc = (volatile uint32_t*)RTC_MMIO;
+    uint64_t lo = rtc[RTC_TIME_LOW / 4];
+    uint64_t hi = rtc[RTC_TIME_HIGH / 4];
+    return (hi << 32) | lo;
+}
+
 void timer_init(void) {
-    // No interrupt setup for now – just use time CSR.
+    // Taken in user mode and in scheduler windows; the kernel keeps SIE clear
+    tick_period = TIMER_FREQ / TIMER_TICK_HZ;
+    next_tick = timer_get_ticks() + tick_period;
+    asm volatile("csrs sie, %0" :: "r"(SIE_STIE));
+    timer_program();
+
+    clock_page = get_free_page();
+    if (!clock_page) {
+        return;
+    }
+    memset((void*)clock_page, 0, PAGE_SIZE);
+    clock_page->freq = TIMER_FREQ;
+    clock_page->boot_ticks = timer_get_ticks();
+    timer_set_wall_ns(rtc_read_ns());
+}
+
+// Called on every timer interrupt; returns 1 when a scheduler tick is due
+int timer_tick(void) {
+    uint64_t now = timer_get_ticks();
+    int due = 0;
+
+    if (now >= next_tick) {
+        due = 1;
+        // Keep the grid; skip ticks that were missed entirely
+        next_tick += tick_period;
+        if (next_tick <= now) {
+            next_tick = now + tick_period;
+        }
+    }
+    timer_program();
+    return due;
 }
 
-void timer_tick(void) {
-    // Not used when we rely on the time CSR directly.
+// Next profiler sample, or ~0UL for none
+void timer_set_sample(uint64_t when) {
+    next_sample = when;
+    timer_program();
 }
 
 uint64_t timer_get_ticks(void) {
@@ -16,3 +83,29 @@ uint64_t timer_get_ticks(void) {
     asm volatile("csrr %0, time" : "=r"(t));
     return t;
 }
+
+uint64_t timer_get_freq(void) {
+    return TIMER_FREQ;
+}
+
+uint64_t timer_ticks_to_us(uint64_t ticks) {
+    return clock_ticks_to_ns(ticks, TIMER_FREQ) / 1000;
+}
+
+// Set the wall clock; readers spin while seq is odd
+void timer_set_wall_ns(uint64_t ns) {
+    if (!clock_page) {
+        return;
+    }
+    uint64_t since_zero = clock_ticks_to_ns(timer_get_ticks(), TIMER_FREQ);
+
+    clock_page->seq++;
+    asm volatile("fence w, w" ::: "memory");
+    clock_page->wall_offset_ns = ns - since_zero;
+    asm volatile("fence w, w" ::: "memory");
+    clock_page->seq++;
+}
+
+void* timer_clock_page(void) {
+    return (void*)clock_page;
+}
@@ -0,0 +1,182 @@
+#include "trace.h"
+#include "kernel.h"
+#include "memory.h"
+#include "task.h"
+#include "fs.h"
+#include "uart.h"
+#include "log.h"
+#include "printf.h"
+#include "string.h"
+#include "types.h"
+
+#ifdef CONFIG_TRACE
+
+_Static_assert(sizeof(trace_event_t) == 32, "trace events are half a cache line");
+_Static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "ring size must be a power of two");
+
+#define TRACE_FREQ      10000000UL      /* time CSR rate on QEMU virt */
+
+typedef struct {
+    trace_event_t* events;
+    uint64_t head;                      /* Events ever recorded */
+} trace_ring_t;
+
+static trace_ring_t rings[MAX_HARTS];
+
+/* Set while dumping so the dump does not overwrite what it reads */
+static int trace_paused = 0;
+
+void trace_hart_init(uint32_t hartid) {
+    if (hartid >= MAX_HARTS) {
+        return;
+    }
+
+    trace_event_t* events = memory_alloc_region(TRACE_EVENTS * sizeof(trace_event_t));
+    if (!events) {
+        printf("trace: no memory for hart %u ring\r\n", hartid);
+        return;
+    }
+    memset(events, 0, TRACE_EVENTS * sizeof(trace_event_t));
+    rings[hartid].head = 0;
+    rings[hartid].events = events;
+}
+
+void trace_event(uint16_t id, uint64_t arg0, uint64_t arg1) {
+    trace_ring_t* ring = &rings[current_hart()];
+    if (!ring->events || trace_paused) {
+        return;
+    }
+
+    /* The ring is only written by its own hart with interrupts off */
+    trace_event_t* ev = &ring->events[ring->head & (TRACE_EVENTS - 1)];
+    asm volatile("rdtime %0" : "=r"(ev->ticks));
+    ev->id = id;
+    ev->hart = (uint16_t)current_hart();
+
+    task_t* current = get_current_task();
+    ev->pid = current ? (uint32_t)current->pid : 0;
+    ev->arg0 = arg0;
+    ev->arg1 = arg1;
+    ring->head++;
+}
+
+void trace_clear(void) {
+    rings[current_hart()].head = 0;
+}
+
+/* Header for the current contents; returns the oldest event's index */
+static uint64_t trace_snapshot(trace_header_t* hdr) {
+    trace_ring_t* ring = &rings[current_hart()];
+    uint64_t first = ring->head > TRACE_EVENTS ? ring->head - TRACE_EVENTS : 0;
+
+    hdr->magic = TRACE_MAGIC;
+    hdr->event_size = sizeof(trace_event_t);
+    hdr->hart = (uint16_t)current_hart();
+    hdr->freq = TRACE_FREQ;
+    hdr->count = ring->head - first;
+    return first;
+}
+
+static void trace_put_hex(const void* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t* p = data;
+    char line[2 * sizeof(trace_event_t) + 2];
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        line[n++] = digits[p[i] >> 4];
+        line[n++] = digits[p[i] & 0xf];
+    }
+    line[n++] = '\r';
+    line[n++] = '\n';
+    uart_write(line, n);
+}
+
+void trace_dump(void) {
+    trace_ring_t* ring = &rings[current_hart()];
+    trace_header_t hdr;
+
+    if (!ring->events) {
+        printf("trace: no ring\r\n");
+        return;
+    }
+
+    /* Bypass the log ring: a full dump is far larger than it holds */
+    log_flush();
+    trace_paused = 1;
+
+    uint64_t first = trace_snapshot(&hdr);
+    uart_puts("--- trace begin ---\r\n");
+    trace_put_hex(&hdr, sizeof(hdr));
+    for (uint64_t i = first; i < ring->head; i++) {
+        trace_put_hex(&ring->events[i & (TRACE_EVENTS - 1)], sizeof(trace_event_t));
+    }
+    uart_puts("--- trace end ---\r\n");
+
+    trace_paused = 0;
+}
+
+int trace_save(const char* name) {
+    trace_ring_t* ring = &rings[current_hart()];
+    trace_header_t hdr;
+
+    if (!ring->events) {
+        return -1;
+    }
+
+    trace_paused = 1;
+
+    uint64_t first = trace_snapshot(&hdr);
+    uint32_t size = sizeof(hdr) + hdr.count * sizeof(trace_event_t);
+
+    /* fs_write_file does not grow an existing file's blocks */
+    file_entry_t* entry = fs_find_file(name);
+    if (entry && entry->blocks * BLOCK_SIZE < size) {
+        trace_paused = 0;
+        return -1;
+    }
+
+    uint8_t* buf = kmalloc(size);
+    if (!buf) {
+        trace_paused = 0;
+        return -1;
+    }
+
+    memcpy(buf, &hdr, sizeof(hdr));
+    trace_event_t* out = (trace_event_t*)(buf + sizeof(hdr));
+    for (uint64_t i = first; i < ring->head; i++) {
+        *out++ = ring->events[i & (TRACE_EVENTS - 1)];
+    }
+
+    int ret = fs_write_file(name, buf, size, 0);
+    kfree(buf);
+
+    trace_paused = 0;
+    return ret;
+}
+
+#else /* !CONFIG_TRACE */
+
+void trace_hart_init(uint32_t hartid) {
+    (void)hartid;
+}
+
+void trace_event(uint16_t id, uint64_t arg0, uint64_t arg1) {
+    (void)id;
+    (void)arg0;
+    (void)arg1;
+}
+
+void trace_clear(void) {
+}
+
+void trace_dump(void) {
+    printf("trace: not built in (make TRACE=1)\r\n");
+}
+
+int trace_save(const char* name) {
+    (void)name;
+    return -1;
+}
+
+#endif
@@ -2,47 +2,202 @@
 #include "timer.h"
 #include "scheduler.h"
 #include "uart.h"
+#include "plic.h"
+#include "log.h"
 #include "printf.h"
+#include "task.h"
+#include "vm.h"
+#include "kernel.h"
+#include "syscall.h"
+#include "uaccess.h"
+#include "trace.h"
+#include "profile.h"
+#include "perf.h"
 
-#define SCAUSE_SUPERVISOR_TIMER 0x8000000000000005ULL
+/* boot/trap.S hard-codes the frame layout */
+_Static_assert(offsetof(trapframe_t, sepc) == 256, "trapframe layout");
+_Static_assert(offsetof(trapframe_t, kernel_sp) == 288, "trapframe layout");
+_Static_assert(sizeof(trapframe_t) <= 304, "trapframe layout");
 
-/* Set mtvec to our trap vector */
-static inline void write_csr_mtvec(uint64_t x) {
-    asm volatile("csrw mtvec, %0" :: "r"(x));
+/* Per-cause counters; [0] = exceptions, [1] = interrupts */
+static trap_stat_t trap_stats[2][TRAP_CAUSES];
+
+/* Set stvec to our trap vector (direct mode) */
+static inline void write_csr_stvec(uint64_t x) {
+    asm volatile("csrw stvec, %0" :: "r"(x));
+}
+
+static inline uint64_t read_cycles(void) {
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+static inline int from_user(trapframe_t* tf) {
+    return !(tf->sstatus & SSTATUS_SPP);
+}
+
+/* Get the message out, then stop this hart for good */
+void panic(const char* msg) {
+    asm volatile("csrc sstatus, %0" :: "r"(SSTATUS_SIE));
+    printf("panic: %s\r\n", msg);
+    log_flush();
+    uart_flush();
+    while (1) {
+        asm volatile("wfi");
+    }
+}
+
+/* ---------- Interrupts ---------- */
+
+static void handle_soft(trapframe_t* tf) {
+    (void)tf;
+    /* Inter-processor interrupt: acknowledge it */
+    asm volatile("csrc sip, %0" :: "r"(1UL << IRQ_S_SOFT));
 }
 
-/* Read scause CSR */
-static inline uint64_t read_csr_scause() {
-    uint64_t x;
-    asm volatile("csrr %0, scause" : "=r"(x));
-    return x;
+static void handle_timer(trapframe_t* tf) {
+    profile_sample(tf);    // no-op unless a sample is due
+
+    /* Only preempt user code; kernel code yields on its own */
+    if (timer_tick() && from_user(tf)) {
+        scheduler_preempt();
+    }
+}
+
+static void handle_external(trapframe_t* tf) {
+    (void)tf;
+    plic_dispatch();
 }
 
-/* Read sepc CSR */
-static inline uint64_t read_csr_sepc() {
-    uint64_t x;
-    asm volatile("csrr %0, sepc" : "=r"(x));
-    return x;
+/* ---------- Exceptions ---------- */
+
+static void handle_ecall(trapframe_t* tf) {
+    /* Normally taken by the fast path in boot/trap.S */
+    syscall_dispatch(tf);
+}
+
+static void handle_page_fault(trapframe_t* tf) {
+    uint64_t cause = tf->scause;
+    uint32_t access = (cause == EXC_INST_PAGE_FAULT) ? VM_EXEC :
+                      (cause == EXC_LOAD_PAGE_FAULT) ? VM_READ : VM_WRITE;
+
+    perf_count_fault(get_current_task());
+
+    /* Demand-load the page from its segment */
+    if (vm_handle_fault(get_current_task(), tf->stval, access) == 0) {
+        return;
+    }
+
+    /* Bad user pointer passed to a copy helper: fail the copy */
+    if (!from_user(tf)) {
+        uint64_t fixup = uaccess_fixup(tf->sepc);
+        if (fixup) {
+            tf->sepc = fixup;
+            return;
+        }
+    }
+
+    printf("Segmentation fault: addr=%lx epc=%lx\r\n", tf->stval, tf->sepc);
+    task_exit(-1);
 }
 
-/* Trap handler called by assembly stub */
-void trap_handler(uint64_t cause, uint64_t epc) {
+static const trap_fn_t interrupt_table[TRAP_CAUSES] = {
+    [IRQ_S_SOFT]  = handle_soft,
+    [IRQ_S_TIMER] = handle_timer,
+    [IRQ_S_EXT]   = handle_external,
+};
+
+static const trap_fn_t exception_table[TRAP_CAUSES] = {
+    [EXC_ECALL_U]          = handle_ecall,
+    [EXC_INST_PAGE_FAULT]  = handle_page_fault,
+    [EXC_LOAD_PAGE_FAULT]  = handle_page_fault,
+    [EXC_STORE_PAGE_FAULT] = handle_page_fault,
+};
+
+uint64_t trap_stat_start(void) {
+    return read_cycles();
+}
 
-    if (cause == SCAUSE_SUPERVISOR_TIMER) {
-        timer_tick();          // increment ticks
-        scheduler_yield();     // allow multitasking
+/* Count one trap of this cause and track its slowest handler run */
+void trap_stat_end(int is_irq, uint64_t code, uint64_t start) {
+    if (code >= TRAP_CAUSES) {
         return;
     }
+    trap_stat_t* st = &trap_stats[is_irq][code];
+    uint64_t cycles = read_cycles() - start;
+    st->count++;
+    if (cycles > st->max_cycles) {
+        st->max_cycles = cycles;
+    }
+}
+
+/*
+ * Trap handler called by assembly stub. Returns the frame to resume.
+ * Switching tasks happens on kernel stacks inside scheduler_yield, so
+ * this is always the frame that was saved.
+ */
+trapframe_t* trap_handler(trapframe_t* tf) {
+    uint64_t start = trap_stat_start();
+    int is_irq = (tf->scause & SCAUSE_INTERRUPT) != 0;
+    uint64_t code = tf->scause & ~SCAUSE_INTERRUPT;
+    int user = from_user(tf);
+
+    TRACE(TRACE_TRAP_ENTER, tf->scause, tf->sepc);
+
+    /* Faults may run long; let the profiler see them */
+    if (!is_irq) {
+        profile_unmask();
+    }
+
+    trap_fn_t fn = NULL;
+    if (code < TRAP_CAUSES) {
+        fn = is_irq ? interrupt_table[code] : exception_table[code];
+    }
+
+    if (fn) {
+        fn(tf);
+    } else {
+        printf("Unhandled trap: cause=%lx epc=%lx\r\n", tf->scause, tf->sepc);
+        if (user) {
+            task_exit(-1);
+        } else {
+            panic("unhandled trap in kernel mode");
+        }
+    }
+
+    trap_stat_end(is_irq, code, start);
 
-    printf("Unhandled trap: cause=%lx epc=%lx\r\n", cause, epc);
+    TRACE(TRACE_TRAP_EXIT, tf->scause, 0);
+    return tf;
+}
+
+void trap_dump_stats(void) {
+    printf("TYPE  CAUSE  COUNT  MAX_CYCLES\r\n");
+    for (int irq = 1; irq >= 0; irq--) {
+        for (int code = 0; code < TRAP_CAUSES; code++) {
+            trap_stat_t* st = &trap_stats[irq][code];
+            if (st->count == 0) {
+                continue;
+            }
+            printf("%s   %d      %lu     %lu\r\n", irq ? "irq" : "exc",
+                   code, st->count, st->max_cycles);
+        }
+    }
 }
 
 /* Trap initialization */
 void trap_init() {
     extern void trap_vector();
 
-    // Set trap entry point
-    write_csr_mtvec((uint64_t)trap_vector);
+    // The kernel runs in S-mode under OpenSBI: traps come through stvec
+    write_csr_stvec((uint64_t)trap_vector);
+
+    // We are in the kernel: traps push their frame on the current stack
+    asm volatile("csrw sscratch, zero");
+
+    // Let user code read cycle, time and instret directly
+    asm volatile("csrw scounteren, %0" :: "r"(0x7UL));
 
     printf("[trap] initialized\r\n");
 }
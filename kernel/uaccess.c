@@ -0,0 +1,87 @@
+#include "uaccess.h"
+#include "task.h"
+#include "paging.h"
+#include "vm.h"
+#include "types.h"
+
+/* boot/uaccess.S */
+size_t uaccess_copy(void* dst, const void* src, size_t n);
+long uaccess_strncpy(char* dst, const char* user_src, size_t n);
+
+/* One entry per user access instruction; the linker script collects them */
+typedef struct {
+    uint64_t insn;
+    uint64_t fixup;
+} ex_entry_t;
+
+extern const ex_entry_t __ex_table_start[];
+extern const ex_entry_t __ex_table_end[];
+
+/* [addr, addr + n) must lie in the user window and in areas allowing access */
+static int user_range_ok(uint64_t addr, size_t n, uint32_t access) {
+    task_t* task = get_current_task();
+    uint64_t end = addr + n;
+
+    if (n == 0) {
+        return 1;
+    }
+    if (!task || end < addr || addr < USER_BASE || end > USER_TOP) {
+        return 0;
+    }
+
+    /* Areas may be adjacent (e.g. .text then .data), so walk them */
+    while (addr < end) {
+        vm_area_t* area = vm_find_area(&task->vm, addr);
+        if (!area || (area->flags & access) != access) {
+            return 0;
+        }
+        addr = area->end;
+    }
+    return 1;
+}
+
+int copy_from_user(void* dst, const void* user_src, size_t n) {
+    if (!user_range_ok((uint64_t)user_src, n, VM_READ)) {
+        return -1;
+    }
+    return uaccess_copy(dst, user_src, n) == 0 ? 0 : -1;
+}
+
+int copy_to_user(void* user_dst, const void* src, size_t n) {
+    if (!user_range_ok((uint64_t)user_dst, n, VM_WRITE)) {
+        return -1;
+    }
+    return uaccess_copy(user_dst, src, n) == 0 ? 0 : -1;
+}
+
+long strncpy_from_user(char* dst, const char* user_src, size_t max) {
+    uint64_t addr = (uint64_t)user_src;
+
+    if (max == 0 || !user_range_ok(addr, 1, VM_READ)) {
+        return -1;
+    }
+
+    /* The length is unknown, so stop at the end of the area */
+    task_t* task = get_current_task();
+    vm_area_t* area = vm_find_area(&task->vm, addr);
+    size_t limit = area->end - addr;
+    if (limit > max) {
+        limit = max;
+    }
+
+    long len = uaccess_strncpy(dst, user_src, limit);
+    if (len < 0 || (size_t)len == limit) {
+        dst[0] = '\0';
+        return -1;
+    }
+    return len;
+}
+
+uint64_t uaccess_fixup(uint64_t epc) {
+    for (const ex_entry_t* e = __ex_table_start; e < __ex_table_end; e++) {
+        if (e->insn == epc) {
+            return e->fixup;
+        }
+    }
+    return 0;
+}
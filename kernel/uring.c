@@ -0,0 +1,97 @@
+#include "uring.h"
+#include "syscall.h"
+#include "task.h"
+#include "vm.h"
+#include "types.h"
+
+_Static_assert(sizeof(uring_t) <= PAGE_SIZE, "ring must fit in one page");
+
+int64_t uring_setup(void) {
+    task_t* task = get_current_task();
+    if (!task || !task->page_table) {
+        return -1;
+    }
+
+    /* Setting up twice hands back the same ring */
+    vm_area_t* area = vm_find_area(&task->vm, URING_BASE);
+    if (area) {
+        return area->start == URING_BASE && area->end == URING_BASE + PAGE_SIZE ?
+               (int64_t)URING_BASE : -1;
+    }
+
+    /* Plain anonymous memory: zero-filled on first touch, freed on exit */
+    if (vm_map_file(&task->vm, URING_BASE, PAGE_SIZE, NULL, 0, 0,
+                    VM_READ | VM_WRITE) != 0) {
+        return -1;
+    }
+    return (int64_t)URING_BASE;
+}
+
+/*
+ * Kernel view of the ring through the direct map. The page is faulted in
+ * (and any copy-on-write share broken) first, so the kernel always sees
+ * the page the task's own mapping points at.
+ */
+static uring_t* uring_get(task_t* task) {
+    vm_area_t* area = vm_find_area(&task->vm, URING_BASE);
+    if (!area || area->start != URING_BASE) {
+        return NULL;
+    }
+
+    pte_t* pte = paging_walk(task->page_table, URING_BASE, 0);
+    if (!pte || !(*pte & PTE_V) || (*pte & PTE_COW)) {
+        if (vm_handle_fault(task, URING_BASE, VM_WRITE) != 0) {
+            return NULL;
+        }
+        pte = paging_walk(task->page_table, URING_BASE, 0);
+    }
+    return (uring_t*)PTE_TO_PA(*pte);
+}
+
+/* Only calls that return to the caller make sense inside a batch */
+static int uring_op_allowed(uint32_t op) {
+    return op == SYS_WRITE || op == SYS_READ_FS || op == SYS_WRITE_FS ||
+           op == SYS_GETPID;
+}
+
+int64_t uring_enter(uint32_t to_submit) {
+    task_t* task = get_current_task();
+    uring_t* ring = task ? uring_get(task) : NULL;
+    if (!ring) {
+        return -1;
+    }
+
+    uint32_t head = ring->sq_head;
+    uint32_t tail = __atomic_load_n(&ring->sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t cq_tail = ring->cq_tail;
+    uint32_t done = 0;
+
+    /* A tail more than a ring ahead is garbage; clamp to one ring */
+    if (tail - head > URING_ENTRIES) {
+        tail = head + URING_ENTRIES;
+    }
+
+    while (done < to_submit && head != tail) {
+        uint32_t cq_head = __atomic_load_n(&ring->cq_head, __ATOMIC_ACQUIRE);
+        if (cq_tail - cq_head >= URING_ENTRIES) {
+            break;  /* Completion ring full */
+        }
+
+        /* Snapshot the entry: the task may rewrite it meanwhile */
+        uring_sqe_t sqe = ring->sqes[head & (URING_ENTRIES - 1)];
+        uint64_t args[SYSCALL_ARGS] = { sqe.args[0], sqe.args[1], sqe.args[2] };
+
+        uring_cqe_t* cqe = &ring->cqes[cq_tail & (URING_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->result = (uring_op_allowed(sqe.op) && sqe.flags == 0) ?
+                      (int64_t)syscall_handler(sqe.op, args) : -1;
+
+        head++;
+        cq_tail++;
+        done++;
+        __atomic_store_n(&ring->sq_head, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->cq_tail, cq_tail, __ATOMIC_RELEASE);
+    }
+
+    return done;
+}
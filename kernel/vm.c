@@ -0,0 +1,319 @@
+#include "vm.h"
+#include "task.h"
+#include "fs.h"
+#include "paging.h"
+#include "memory.h"
+#include "imgcache.h"
+#include "clock.h"
+#include "string.h"
+#include "types.h"
+
+#define PAGE_ROUND_DOWN(x) ((x) & ~(uint64_t)(PAGE_SIZE - 1))
+
+void vm_space_init(vm_space_t* vs) {
+    memset(vs, 0, sizeof(*vs));
+}
+
+/* Record a mapping; nothing is read until the pages are touched */
+int vm_map_file(vm_space_t* vs, uint64_t start, uint64_t memsz,
+                const file_entry_t* file, uint32_t offset, uint64_t filesz,
+                uint32_t flags) {
+    if (vs->num_areas >= VM_MAX_AREAS || memsz == 0 || filesz > memsz) {
+        return -1;
+    }
+
+    /* Everything a task maps lives in the user window */
+    uint64_t end = start + memsz;
+    if (end < start || start < USER_BASE || end > USER_TOP) {
+        return -1;
+    }
+
+    /* The clock page sits at a fixed address in every task */
+    if (start < CLOCK_PAGE_BASE + PAGE_SIZE && end > CLOCK_PAGE_BASE) {
+        return -1;
+    }
+
+    /* Areas must not overlap */
+    for (int i = 0; i < vs->num_areas; i++) {
+        if (start < vs->areas[i].end && end > vs->areas[i].start) {
+            return -1;
+        }
+    }
+
+    vm_area_t* area = &vs->areas[vs->num_areas++];
+    area->start       = start;
+    area->end         = end;
+    area->file_end    = file ? start + filesz : start;
+    area->file_offset = offset;
+    area->flags       = flags;
+    area->ino         = file ? fs_entry_ino(file) : 0;
+    area->gen         = file ? file->gen : 0;
+    area->file        = file;
+
+    return 0;
+}
+
+vm_area_t* vm_find_area(vm_space_t* vs, uint64_t addr) {
+    for (int i = 0; i < vs->num_areas; i++) {
+        if (addr >= vs->areas[i].start && addr < vs->areas[i].end) {
+            return &vs->areas[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Write the contents of the page at page_va into page: file bytes where
+ * an area is file-backed, zeroes for the BSS tail. Bytes that no area
+ * covers are left untouched. Several areas can share a page (e.g. the
+ * end of .text and the start of .data), so all of them are applied.
+ */
+static int vm_fill_page(vm_space_t* vs, uint64_t page_va, uint8_t* page) {
+    uint64_t page_end = page_va + PAGE_SIZE;
+
+    for (int i = 0; i < vs->num_areas; i++) {
+        vm_area_t* area = &vs->areas[i];
+        uint64_t lo = area->start > page_va ? area->start : page_va;
+        uint64_t hi = area->end < page_end ? area->end : page_end;
+
+        if (lo >= hi) {
+            continue;
+        }
+
+        /* File-backed part */
+        uint64_t file_hi = hi < area->file_end ? hi : area->file_end;
+        if (lo < file_hi) {
+            uint32_t len = (uint32_t)(file_hi - lo);
+            uint32_t off = area->file_offset + (uint32_t)(lo - area->start);
+            if (fs_read_entry(area->file, page + (lo - page_va), len, off) != (int)len) {
+                return -1;
+            }
+        }
+
+        /* Zero-fill part */
+        uint64_t zero_lo = lo > area->file_end ? lo : area->file_end;
+        if (zero_lo < hi) {
+            memset(page + (zero_lo - page_va), 0, hi - zero_lo);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read-only file pages can be shared through the image cache when no
+ * other area touches the page, so the contents depend only on the file.
+ * Fills in the cache key and returns 1 if page_va qualifies.
+ */
+static int vm_shared_page_key(vm_space_t* vs, vm_area_t* area, uint64_t page_va,
+                              imgcache_key_t* key) {
+    if (!area->file || (area->flags & VM_WRITE)) {
+        return 0;
+    }
+
+    /* The file offset must be congruent with the address */
+    if ((area->start - area->file_offset) & (PAGE_SIZE - 1)) {
+        return 0;
+    }
+
+    for (int i = 0; i < vs->num_areas; i++) {
+        vm_area_t* other = &vs->areas[i];
+        if (other != area && other->start < page_va + PAGE_SIZE && other->end > page_va) {
+            return 0;
+        }
+    }
+
+    key->ino    = area->ino;
+    key->gen    = area->gen;
+    key->offset = (uint32_t)(area->file_offset + page_va - area->start);
+    return 1;
+}
+
+static uint64_t vm_pte_flags(uint32_t flags) {
+    uint64_t pte = PTE_U | PTE_A | PTE_D;
+    if (flags & VM_READ)  pte |= PTE_R;
+    if (flags & VM_WRITE) pte |= PTE_W;
+    if (flags & VM_EXEC)  pte |= PTE_X;
+    return pte;
+}
+
+/* Permissions of every area that touches the page, like vm_fill_page */
+static uint32_t vm_page_flags(vm_space_t* vs, uint64_t page_va) {
+    uint32_t flags = 0;
+
+    for (int i = 0; i < vs->num_areas; i++) {
+        vm_area_t* area = &vs->areas[i];
+        if (area->start < page_va + PAGE_SIZE && area->end > page_va) {
+            flags |= area->flags;
+        }
+    }
+    return flags;
+}
+
+/*
+ * Write to a copy-on-write page: take the page over if this is the
+ * last mapping, otherwise copy it and drop our reference to the shared one.
+ */
+static int vm_cow_fault(task_t* task, uint64_t page_va, pte_t* pte) {
+    void* page = (void*)PTE_TO_PA(*pte);
+    uint64_t flags = (*pte & PTE_FLAGS_MASK & ~PTE_COW) | PTE_W | PTE_D;
+
+    if (page_ref_count(page) > 1) {
+        void* copy = get_free_page();
+        if (!copy) {
+            return -1;
+        }
+        memcpy(copy, page, PAGE_SIZE);
+        free_page(page);
+        page = copy;
+    }
+
+    *pte = PA_TO_PTE(page) | flags;
+    paging_flush_page(page_va, task->satp);
+    return 0;
+}
+
+int vm_handle_fault(task_t* task, uint64_t addr, uint32_t access) {
+    if (!task) {
+        return -1;
+    }
+
+    vm_area_t* area = vm_find_area(&task->vm, addr);
+    if (!area || (area->flags & access) != access) {
+        return -1;
+    }
+
+    uint64_t page_va = PAGE_ROUND_DOWN(addr);
+
+    /* Already mapped: either a copy-on-write page or a protection fault */
+    pte_t* pte = paging_walk(task->page_table, page_va, 0);
+    if (pte && (*pte & PTE_V)) {
+        if (access == VM_WRITE && (*pte & PTE_COW)) {
+            return vm_cow_fault(task, page_va, pte);
+        }
+        return -1;
+    }
+
+    imgcache_key_t key;
+    int shared = vm_shared_page_key(&task->vm, area, page_va, &key);
+    void* page = shared ? imgcache_lookup(&key) : NULL;
+
+    if (!page) {
+        void* fresh = get_free_page();
+        if (!fresh) {
+            return -1;
+        }
+        if (vm_fill_page(&task->vm, page_va, fresh) != 0) {
+            free_page(fresh);
+            return -1;
+        }
+
+        page = fresh;
+        /* The fill read the file as it is now: if it was rewritten since
+         * the map, the page must not be cached under the old generation */
+        if (shared && area->file->gen == area->gen) {
+            /* A full cache leaves the page private to this task */
+            void* cached = imgcache_insert(&key, fresh);
+            if (cached && cached != fresh) {
+                free_page(fresh);
+                page = cached;
+            }
+        }
+    }
+
+    uint64_t pte_flags = vm_pte_flags(vm_page_flags(&task->vm, page_va));
+    if (paging_map(task->page_table, page_va, (uint64_t)page, pte_flags) != 0) {
+        if (!shared || imgcache_put(&key, page) != 0) {
+            free_page(page);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+int vm_map_page(task_t* task, uint64_t va, void* page) {
+    uint64_t page_va = PAGE_ROUND_DOWN(va);
+    uint32_t flags = vm_page_flags(&task->vm, page_va);
+
+    if (!flags || !task->page_table) {
+        return -1;
+    }
+    return paging_map(task->page_table, page_va, (uint64_t)page, vm_pte_flags(flags));
+}
+
+void vm_space_release(task_t* task) {
+    vm_space_t* vs = &task->vm;
+
+    if (task->page_table) {
+        for (int i = 0; i < vs->num_areas; i++) {
+            vm_area_t* area = &vs->areas[i];
+
+            for (uint64_t va = PAGE_ROUND_DOWN(area->start); va < area->end; va += PAGE_SIZE) {
+                imgcache_key_t key;
+                uint64_t pa = paging_unmap(task->page_table, va, task->satp);
+                if (!pa) {
+                    continue;
+                }
+
+                /* Shared pages go back to the cache, private ones are freed */
+                if (vm_shared_page_key(vs, area, va, &key) &&
+                    imgcache_put(&key, (void*)pa) == 0) {
+                    continue;
+                }
+                free_page((void*)pa);
+            }
+        }
+    }
+
+    vm_space_init(vs);
+}
+
+/*
+ * Give child the parent's areas and share every present page with it.
+ * Writable pages are made read-only in both tables and copied on the
+ * first write, so the cost is one PTE per mapped page rather than a
+ * copy of the memory.
+ */
+int vm_space_fork(task_t* parent, task_t* child) {
+    vm_space_t* vs = &parent->vm;
+
+    child->vm = parent->vm;
+    if (!parent->page_table || !child->page_table) {
+        return 0;
+    }
+
+    for (int i = 0; i < vs->num_areas; i++) {
+        vm_area_t* area = &vs->areas[i];
+
+        for (uint64_t va = PAGE_ROUND_DOWN(area->start); va < area->end; va += PAGE_SIZE) {
+            pte_t* pte = paging_walk(parent->page_table, va, 0);
+            if (!pte || !(*pte & PTE_V)) {
+                continue;
+            }
+
+            pte_t* child_pte = paging_walk(child->page_table, va, 1);
+            if (!child_pte) {
+                return -1;
+            }
+            if (*child_pte & PTE_V) {
+                continue;  /* Page shared by two areas, already done */
+            }
+
+            void* page = (void*)PTE_TO_PA(*pte);
+            imgcache_key_t key;
+            if (!vm_shared_page_key(vs, area, va, &key) || imgcache_get(&key, page) != 0) {
+                page_ref_get(page);
+            }
+
+            if (*pte & PTE_W) {
+                *pte = (*pte & ~PTE_W) | PTE_COW;
+            }
+            *child_pte = *pte;
+        }
+    }
+
+    /* The parent's writable pages just became read-only */
+    paging_flush_asid(parent->satp);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Symbolize a `profile dump` console capture against kernel.elf.
+
+Prints a flat profile (where samples landed) and an inclusive one (time
+under each function), or folded stacks for flamegraph.pl with --folded.
+Symbols come from `nm`; set CROSS_COMPILE to pick the toolchain prefix.
+
+    tools/profile2sym.py kernel.elf console.log
+    tools/profile2sym.py --folded kernel.elf console.log | flamegraph.pl > prof.svg
+"""
+
+import bisect
+import collections
+import os
+import subprocess
+import sys
+
+
+def load_symbols(elf):
+    nm = os.environ.get("CROSS_COMPILE", "riscv64-unknown-elf-") + "nm"
+    out = subprocess.run([nm, "-n", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    addrs, names = [], []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            addrs.append(int(parts[0], 16))
+            names.append(parts[2])
+    return addrs, names
+
+
+def symbolize(syms, pc):
+    addrs, names = syms
+    i = bisect.bisect_right(addrs, pc) - 1
+    return names[i] if i >= 0 else "0x%x" % pc
+
+
+def parse(path):
+    """Return (header, [(count, user, [pc...])]) from the dump markers."""
+    header, stacks, inside = "", [], False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line == "--- profile begin ---":
+                header, stacks, inside = "", [], True
+            elif line == "--- profile end ---":
+                inside = False
+            elif inside and line.startswith("hz "):
+                header = line
+            elif inside and line:
+                fields = line.split()
+                pcs = [int(x, 16) for x in fields[2:]]
+                stacks.append((int(fields[0]), fields[1] == "u", pcs))
+    if not stacks:
+        sys.exit("profile2sym: no profile dump found")
+    return header, stacks
+
+
+def frames(syms, user, pcs):
+    """Function names leaf first; return addresses point past the call."""
+    if user:
+        return ["[user]"]
+    return [symbolize(syms, pc if i == 0 else pc - 1) for i, pc in enumerate(pcs)]
+
+
+def main():
+    args = sys.argv[1:]
+    folded = "--folded" in args
+    args = [a for a in args if a != "--folded"]
+    if len(args) != 2:
+        sys.exit("usage: profile2sym.py [--folded] <kernel.elf> <console log>")
+
+    syms = load_symbols(args[0])
+    header, stacks = parse(args[1])
+
+    if folded:
+        merged = collections.Counter()
+        for count, user, pcs in stacks:
+            merged[";".join(reversed(frames(syms, user, pcs)))] += count
+        for stack, count in merged.most_common():
+            print("%s %d" % (stack, count))
+        return
+
+    total = sum(count for count, _, _ in stacks)
+    flat = collections.Counter()
+    incl = collections.Counter()
+    for count, user, pcs in stacks:
+        names = frames(syms, user, pcs)
+        flat[names[0]] += count
+        for name in set(names):
+            incl[name] += count
+
+    print(header)
+    print("\n%-8s %6s  %s" % ("SELF", "%", "FUNCTION"))
+    for name, count in flat.most_common(30):
+        print("%-8d %5.1f%%  %s" % (count, 100.0 * count / total, name))
+    print("\n%-8s %6s  %s" % ("TOTAL", "%", "FUNCTION"))
+    for name, count in incl.most_common(30):
+        print("%-8d %5.1f%%  %s" % (count, 100.0 * count / total, name))
+
+
+if __name__ == "__main__":
+    main()
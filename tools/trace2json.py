@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Convert a kernel trace buffer to Chrome trace JSON.
+
+The input is either a file saved with `trace save <file>` and copied off
+the disk image, or a console capture containing the hex lines printed by
+`trace dump`. Open the output in chrome://tracing or ui.perfetto.dev.
+
+    tools/trace2json.py console.log > trace.json
+"""
+
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x31435254
+HEADER = struct.Struct("<IHHQQ")    # trace_header_t
+EVENT = struct.Struct("<QHHIQQ")    # trace_event_t
+
+# Keep in step with trace_id_t in include/trace.h: name, phase, arg names
+EVENTS = {
+    1: ("sched_switch", "i", ("prev", "next")),
+    2: ("task_create", "i", ("pid", "ppid")),
+    3: ("task_exit", "i", ("pid", "code")),
+    4: ("kmalloc", "i", ("size", "ptr")),
+    5: ("kfree", "i", ("ptr", None)),
+    6: ("fs_read", "B", ("size", "offset")),
+    7: ("fs_read", "E", ("result", None)),
+    8: ("fs_write", "B", ("size", "offset")),
+    9: ("fs_write", "E", ("result", None)),
+    10: ("elf_load", "B", (None, None)),
+    11: ("elf_load", "E", ("result", "entry")),
+    12: ("trap", "B", ("scause", "sepc")),
+    13: ("trap", "E", (None, None)),
+    14: ("syscall", "B", ("num", None)),
+    15: ("syscall", "E", (None, "result")),
+}
+
+
+def from_console(text):
+    """Collect the hex lines between the dump markers."""
+    data = bytearray()
+    inside = False
+    for line in text.splitlines():
+        line = line.strip()
+        if line == "--- trace begin ---":
+            data.clear()
+            inside = True
+        elif line == "--- trace end ---":
+            inside = False
+        elif inside and line:
+            data += bytes.fromhex(line)
+    return bytes(data)
+
+
+def load(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if len(raw) >= 4 and struct.unpack_from("<I", raw)[0] == TRACE_MAGIC:
+        return raw
+    return from_console(raw.decode("ascii", errors="replace"))
+
+
+def convert(raw):
+    if len(raw) < HEADER.size:
+        sys.exit("trace2json: no trace data found")
+    magic, event_size, hart, freq, count = HEADER.unpack_from(raw)
+    if magic != TRACE_MAGIC or event_size != EVENT.size:
+        sys.exit("trace2json: bad trace header")
+
+    out = []
+    for i in range(count):
+        off = HEADER.size + i * EVENT.size
+        if off + EVENT.size > len(raw):
+            break
+        ticks, eid, ev_hart, pid, arg0, arg1 = EVENT.unpack_from(raw, off)
+        name, phase, labels = EVENTS.get(eid, ("event_%d" % eid, "i", ("arg0", "arg1")))
+        args = {}
+        for label, value in zip(labels, (arg0, arg1)):
+            if label:
+                args[label] = value
+        ev = {
+            "name": name,
+            "ph": phase,
+            "ts": ticks * 1e6 / freq,
+            "pid": ev_hart,
+            "tid": pid,
+            "args": args,
+        }
+        if phase == "i":
+            ev["s"] = "t"
+        out.append(ev)
+
+    return {"traceEvents": out, "displayTimeUnit": "ns",
+            "otherData": {"hart": hart, "freq": freq}}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: trace2json.py <trace file | console log>")
+    json.dump(convert(load(sys.argv[1])), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()